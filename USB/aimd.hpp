@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+
+// AIMD limit on outstanding lookups. Healthy completions grow the window by about one request
+// per window's worth of completions; errors halve it and latency well above the best seen
+// trims it. At most one decrease is applied per window so a burst of failures from the same
+// round doesn't collapse it to the floor.
+struct AimdController
+{
+    double window = 4.0;
+    double minWindow = 1.0;
+    double maxWindow = 32.0;
+    double latencyTolerance = 2.5;
+    double latencyDecrease = 0.8;
+    double errorDecrease = 0.5;
+
+    double baselineMs = 0.0;
+    double sinceDecrease = 0.0;
+
+    size_t Limit() const
+    {
+        return static_cast<size_t>(window);
+    }
+
+    void SetCeiling(size_t ceiling)
+    {
+        maxWindow = std::max(minWindow, static_cast<double>(ceiling));
+        window = std::min(window, maxWindow);
+    }
+
+    void Decrease(double factor)
+    {
+        if (sinceDecrease < window)
+            return;
+        window = std::max(minWindow, window * factor);
+        sinceDecrease = 0.0;
+    }
+
+    void OnResult(double latencyMs, bool ok)
+    {
+        sinceDecrease += 1.0;
+
+        if (!ok)
+        {
+            Decrease(errorDecrease);
+            return;
+        }
+
+        // The baseline is the fastest round trip seen. At the floor any sample is by definition
+        // unloaded latency, so a move to a slower server resets it instead of pinning the
+        // controller in decrease mode.
+        if (baselineMs == 0.0 || latencyMs < baselineMs || window <= minWindow)
+            baselineMs = latencyMs;
+
+        if (latencyMs > baselineMs * latencyTolerance)
+        {
+            Decrease(latencyDecrease);
+        }
+        else
+        {
+            window = std::min(maxWindow, window + 1.0 / window);
+        }
+    }
+};
@@ -0,0 +1,736 @@
+﻿#pragma once
+#ifdef _WIN32
+#include <windows.h>
+#include <setupapi.h>
+#include <cfgmgr32.h>
+#include <devpkey.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Everything a scan needs from one USB devnode, gathered in a single pass. Presence comes with
+// the record, so no second, present-only enumeration has to be joined against the full one.
+struct DevnodeRecord
+{
+    std::string instanceId;
+    std::string name;           // friendly name, else the device description
+    std::string vendor;         // manufacturer
+    std::string service;
+    uint64_t arrivalTime = 0;   // FILETIME ticks, 0 when unknown
+    uint64_t removalTime = 0;
+    uint32_t status = 0;        // DN_* flags; only meaningful while present
+    uint32_t problem = 0;
+    uint32_t capabilities = 0;  // CM_DEVCAP_* flags
+    uint32_t generation = 0;    // bumped by the backend each time the devnode is re-enumerated, if it can tell
+    bool present = false;
+    uint64_t handle = 0;        // backend-private reference from Survey to Fill
+
+    // What Survey reads. Anything else about a devnode only changes along with one of these.
+    bool SameSignature(const DevnodeRecord& other) const
+    {
+        return present == other.present && status == other.status && arrivalTime == other.arrivalTime && removalTime == other.removalTime &&
+            generation == other.generation;
+    }
+};
+
+// Runs body(index) for every index in [0, count) on a small pool of threads. Workers claim
+// fixed-size chunks of the index space as they go; callers write into pre-sized slots, so the
+// result is in index order no matter which thread did the work.
+template <typename Body>
+void ParallelFor(size_t count, Body body, size_t maxWorkers = 8, size_t chunkSize = 32)
+{
+    size_t chunks = (count + chunkSize - 1) / chunkSize;
+    // The reads block on the PnP manager rather than burn CPU, so the pool is not capped at the
+    // core count.
+    size_t workers = std::max<size_t>(1, std::min(maxWorkers, chunks));
+
+    std::atomic<size_t> nextChunk{ 0 };
+    auto work = [&]()
+    {
+        for (size_t chunk = nextChunk++; chunk < chunks; chunk = nextChunk++)
+        {
+            size_t end = std::min(count, (chunk + 1) * chunkSize);
+            for (size_t i = chunk * chunkSize; i < end; ++i)
+                body(i);
+        }
+    };
+
+    // The calling thread is one of the workers.
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (std::thread& thread : pool)
+        thread.join();
+}
+
+// Source of devnode records, read in two steps. Survey is the cheap pass: instance id plus the
+// signature fields (presence, status, arrival and removal time). Fill reads the rest for one
+// surveyed record. A full scan fills everything; a rescan only what changed. The live backend
+// asks the PnP manager; the recorded one replays a fixture so the scan logic runs anywhere.
+struct DevnodeBackend
+{
+    size_t maxWorkers = 8;
+
+    virtual ~DevnodeBackend() = default;
+
+    // Replaces out with one record per USB devnode, present or not, signature fields only.
+    virtual bool Survey(std::vector<DevnodeRecord>& out) = 0;
+
+    // Completes a record from the latest Survey. Must be safe to call from several threads.
+    virtual void Fill(DevnodeRecord& record) = 0;
+
+    // Surveys the one devnode with this instance id, for hotplug updates. False when the backend
+    // no longer knows it. The default runs a whole Survey; backends that can look a devnode up
+    // directly override it. Must be safe to call from several threads.
+    virtual bool Locate(const std::string& instanceId, DevnodeRecord& out)
+    {
+        std::vector<DevnodeRecord> all;
+        if (!Survey(all))
+            return false;
+        for (DevnodeRecord& r : all)
+        {
+            if (r.instanceId == instanceId)
+            {
+                out = std::move(r);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Enumerate(std::vector<DevnodeRecord>& out)
+    {
+        if (!Survey(out))
+            return false;
+        ParallelFor(out.size(), [&](size_t i) { Fill(out[i]); }, maxWorkers);
+        return true;
+    }
+};
+
+// What changed between two surveys, as indexes into the new record list (removed ones index the
+// previous list).
+struct DevnodeDelta
+{
+    std::vector<size_t> added;
+    std::vector<size_t> changed;
+    std::vector<size_t> removed;
+    size_t unchanged = 0;
+
+    bool Empty() const
+    {
+        return added.empty() && changed.empty() && removed.empty();
+    }
+};
+
+// The last scan's records, kept so a rescan can survey, carry unchanged records over as they
+// are and fill only the devnodes whose signature moved.
+struct DevnodeSnapshot
+{
+    std::vector<DevnodeRecord> records;
+    bool valid = false;
+
+    // Full scan when there is no previous snapshot yet.
+    bool Rescan(DevnodeBackend& backend, DevnodeDelta& delta)
+    {
+        delta = DevnodeDelta{};
+
+        std::vector<DevnodeRecord> current;
+        if (!backend.Survey(current))
+            return false;
+
+        std::unordered_map<std::string, size_t> previous;
+        previous.reserve(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+            previous.emplace(records[i].instanceId, i);
+
+        std::vector<size_t> stale;
+        std::vector<bool> seen(records.size(), false);
+        for (size_t i = 0; i < current.size(); ++i)
+        {
+            auto it = valid ? previous.find(current[i].instanceId) : previous.end();
+            if (it == previous.end())
+            {
+                delta.added.push_back(i);
+                stale.push_back(i);
+                continue;
+            }
+
+            seen[it->second] = true;
+            if (current[i].SameSignature(records[it->second]))
+            {
+                uint64_t handle = current[i].handle;
+                current[i] = records[it->second];
+                current[i].handle = handle;
+                ++delta.unchanged;
+            }
+            else
+            {
+                delta.changed.push_back(i);
+                stale.push_back(i);
+            }
+        }
+
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (valid && !seen[i])
+                delta.removed.push_back(i);
+        }
+
+        ParallelFor(stale.size(), [&](size_t i) { backend.Fill(current[stale[i]]); }, backend.maxWorkers);
+
+        records = std::move(current);
+        valid = true;
+        return true;
+    }
+
+    // Re-reads only the named devnodes, as reported by a hotplug monitor, and patches them into
+    // the snapshot. Ids must be distinct. Delta indexes follow Rescan's: added and changed into
+    // the new list, removed into the old one. Full scan when there is no snapshot yet.
+    bool Update(DevnodeBackend& backend, const std::vector<std::string>& instanceIds, DevnodeDelta& delta)
+    {
+        if (!valid)
+            return Rescan(backend, delta);
+
+        delta = DevnodeDelta{};
+
+        std::vector<DevnodeRecord> surveyed(instanceIds.size());
+        std::vector<char> found(instanceIds.size(), 0);
+        ParallelFor(instanceIds.size(), [&](size_t i) { found[i] = backend.Locate(instanceIds[i], surveyed[i]); }, backend.maxWorkers);
+
+        std::unordered_map<std::string, size_t> previous;
+        previous.reserve(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+            previous.emplace(records[i].instanceId, i);
+
+        std::vector<bool> gone(records.size(), false);
+        std::vector<bool> moved(records.size(), false);
+        std::vector<DevnodeRecord> arrivals;
+        for (size_t i = 0; i < instanceIds.size(); ++i)
+        {
+            auto it = previous.find(instanceIds[i]);
+            if (!found[i])
+            {
+                if (it != previous.end())
+                {
+                    gone[it->second] = true;
+                    delta.removed.push_back(it->second);
+                }
+                continue;
+            }
+
+            if (it == previous.end())
+            {
+                arrivals.push_back(std::move(surveyed[i]));
+                continue;
+            }
+
+            DevnodeRecord& record = records[it->second];
+            if (surveyed[i].SameSignature(record))
+            {
+                record.handle = surveyed[i].handle;
+                continue;
+            }
+            record = std::move(surveyed[i]);
+            moved[it->second] = true;
+        }
+
+        std::vector<DevnodeRecord> current;
+        current.reserve(records.size() - delta.removed.size() + arrivals.size());
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (gone[i])
+                continue;
+            if (moved[i])
+                delta.changed.push_back(current.size());
+            current.push_back(std::move(records[i]));
+        }
+        for (DevnodeRecord& r : arrivals)
+        {
+            delta.added.push_back(current.size());
+            current.push_back(std::move(r));
+        }
+        delta.unchanged = current.size() - delta.added.size() - delta.changed.size();
+
+        std::vector<size_t> stale(delta.changed);
+        stale.insert(stale.end(), delta.added.begin(), delta.added.end());
+        ParallelFor(stale.size(), [&](size_t i) { backend.Fill(current[stale[i]]); }, backend.maxWorkers);
+
+        records = std::move(current);
+        return true;
+    }
+};
+
+// Linux has no instance ids. A usb_device gets a Windows-shaped one built from its vendor and
+// product ids and its kernel name (the bus-port path, e.g. 1-2.4), so the VID_/PID_ parsing
+// downstream works unchanged and the hotplug monitor and sysfs backend agree on the key.
+inline std::string UsbInstanceId(unsigned vid, unsigned pid, const std::string& kernelName)
+{
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "USB\\VID_%04X&PID_%04X\\", vid & 0xFFFF, pid & 0xFFFF);
+    return prefix + kernelName;
+}
+
+// Fixture format: one devnode per line, tab-separated in DevnodeRecord order except that present
+// comes first. Fields must not contain tabs or newlines. Fixtures written before generation was
+// added have ten fields and load with generation 0.
+inline bool WriteDevnodeFixture(const std::string& path, const std::vector<DevnodeRecord>& records)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+
+    for (const DevnodeRecord& r : records)
+    {
+        out << (r.present ? 1 : 0) << '\t' << r.instanceId << '\t' << r.name << '\t' << r.vendor << '\t' << r.service << '\t'
+            << r.arrivalTime << '\t' << r.removalTime << '\t' << r.status << '\t' << r.problem << '\t' << r.capabilities << '\t' << r.generation << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+// Replays a recorded devnode list. With a per-call latency set it also stands in for the cost of
+// the property reads, surveyReads blocking calls per devnode in Survey and fillReads in Fill,
+// so rescans and parallel scaling can be measured without Windows. Edit records between scans
+// to simulate arrivals and removals.
+struct RecordedDevnodeBackend : DevnodeBackend
+{
+    std::vector<DevnodeRecord> records;
+    std::chrono::microseconds callLatency{ 0 };
+    size_t surveyReads = 4;
+    size_t fillReads = 5;
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+
+        records.clear();
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::vector<std::string> fields;
+            std::stringstream row(line);
+            std::string field;
+            while (std::getline(row, field, '\t'))
+                fields.push_back(field);
+            if (fields.size() != 10 && fields.size() != 11)
+                continue;
+
+            DevnodeRecord r;
+            r.present = fields[0] == "1";
+            r.instanceId = fields[1];
+            r.name = fields[2];
+            r.vendor = fields[3];
+            r.service = fields[4];
+            r.arrivalTime = strtoull(fields[5].c_str(), nullptr, 10);
+            r.removalTime = strtoull(fields[6].c_str(), nullptr, 10);
+            r.status = static_cast<uint32_t>(strtoul(fields[7].c_str(), nullptr, 10));
+            r.problem = static_cast<uint32_t>(strtoul(fields[8].c_str(), nullptr, 10));
+            r.capabilities = static_cast<uint32_t>(strtoul(fields[9].c_str(), nullptr, 10));
+            if (fields.size() == 11)
+                r.generation = static_cast<uint32_t>(strtoul(fields[10].c_str(), nullptr, 10));
+            records.push_back(std::move(r));
+        }
+        return true;
+    }
+
+    void Wait(size_t calls) const
+    {
+        if (callLatency.count() != 0)
+            std::this_thread::sleep_for(callLatency * calls);
+    }
+
+    bool Survey(std::vector<DevnodeRecord>& out) override
+    {
+        out.assign(records.size(), DevnodeRecord{});
+        ParallelFor(records.size(), [&](size_t i)
+        {
+            Wait(surveyReads);
+            const DevnodeRecord& r = records[i];
+            out[i].instanceId = r.instanceId;
+            out[i].present = r.present;
+            out[i].status = r.status;
+            out[i].problem = r.problem;
+            out[i].arrivalTime = r.arrivalTime;
+            out[i].removalTime = r.removalTime;
+            out[i].generation = r.generation;
+            out[i].handle = i;
+        }, maxWorkers);
+        return true;
+    }
+
+    bool Locate(const std::string& instanceId, DevnodeRecord& out) override
+    {
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (records[i].instanceId != instanceId)
+                continue;
+
+            Wait(surveyReads);
+            const DevnodeRecord& r = records[i];
+            out = DevnodeRecord{};
+            out.instanceId = r.instanceId;
+            out.present = r.present;
+            out.status = r.status;
+            out.problem = r.problem;
+            out.arrivalTime = r.arrivalTime;
+            out.removalTime = r.removalTime;
+            out.generation = r.generation;
+            out.handle = i;
+            return true;
+        }
+        return false;
+    }
+
+    void Fill(DevnodeRecord& record) override
+    {
+        Wait(fillReads);
+        const DevnodeRecord& r = records[record.handle];
+        record.name = r.name;
+        record.vendor = r.vendor;
+        record.service = r.service;
+        record.capabilities = r.capabilities;
+    }
+};
+
+#ifdef _WIN32
+inline std::string WideToUtf8(const std::wstring& w)
+{
+    if (w.empty()) return {};
+    int size = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    std::string s(size - 1, 0);
+    WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, s.data(), size, nullptr, nullptr);
+    return s;
+}
+
+// One SetupDi list of every USB devnode, phantoms included. A devnode that is not present has no
+// live DevInst, so CM_Get_DevNode_Status answers CR_NO_SUCH_DEVINST for it. The list is kept
+// open from Survey until the next Survey so Fill can still use the DevInsts.
+// Listing the devnodes is cheap; the blocking property reads are what cost, so they are spread
+// over ParallelFor's workers. Those only use CfgMgr32 calls on a DevInst, which are safe to make
+// concurrently, and never touch the shared device info set.
+struct SetupDiDevnodeBackend : DevnodeBackend
+{
+    HDEVINFO hDevInfo = INVALID_HANDLE_VALUE;
+
+    SetupDiDevnodeBackend() = default;
+    SetupDiDevnodeBackend(const SetupDiDevnodeBackend&) = delete;
+    SetupDiDevnodeBackend& operator=(const SetupDiDevnodeBackend&) = delete;
+
+    ~SetupDiDevnodeBackend()
+    {
+        if (hDevInfo != INVALID_HANDLE_VALUE)
+            SetupDiDestroyDeviceInfoList(hDevInfo);
+    }
+
+    static uint64_t GetDevNodeTime(DEVINST devInst, const DEVPROPKEY& key)
+    {
+        FILETIME ft{};
+        DEVPROPTYPE type;
+        ULONG size = sizeof(FILETIME);
+        if (CM_Get_DevNode_PropertyW(devInst, &key, &type, (PBYTE)&ft, &size, 0) != CR_SUCCESS || type != DEVPROP_TYPE_FILETIME)
+            return 0;
+        return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    }
+
+    static std::string GetProperty(DEVINST devInst, ULONG property)
+    {
+        wchar_t buf[512]{};
+        ULONG size = sizeof(buf);
+        if (CM_Get_DevNode_Registry_PropertyW(devInst, property, nullptr, buf, &size, 0) != CR_SUCCESS)
+            return std::string();
+        return WideToUtf8(buf);
+    }
+
+    bool Survey(std::vector<DevnodeRecord>& out) override
+    {
+        if (hDevInfo != INVALID_HANDLE_VALUE)
+            SetupDiDestroyDeviceInfoList(hDevInfo);
+        hDevInfo = SetupDiGetClassDevsW(nullptr, L"USB", nullptr, DIGCF_ALLCLASSES);
+        if (hDevInfo == INVALID_HANDLE_VALUE)
+            return false;
+
+        out.clear();
+        SP_DEVINFO_DATA dev{};
+        dev.cbSize = sizeof(dev);
+        for (DWORD index = 0; SetupDiEnumDeviceInfo(hDevInfo, index, &dev); ++index)
+        {
+            DevnodeRecord r;
+            r.handle = dev.DevInst;
+            out.push_back(std::move(r));
+        }
+
+        ParallelFor(out.size(), [&](size_t i) { SurveyDevInst(out[i]); }, maxWorkers);
+        return true;
+    }
+
+    // The signature reads for one devnode whose DevInst is already in record.handle.
+    static void SurveyDevInst(DevnodeRecord& r)
+    {
+        DEVINST devInst = static_cast<DEVINST>(r.handle);
+
+        wchar_t instanceId[MAX_DEVICE_ID_LEN]{};
+        CM_Get_Device_IDW(devInst, instanceId, MAX_DEVICE_ID_LEN, 0);
+        r.instanceId = WideToUtf8(instanceId);
+
+        ULONG status = 0, problem = 0;
+        r.present = CM_Get_DevNode_Status(&status, &problem, devInst, 0) != CR_NO_SUCH_DEVINST;
+        r.status = status;
+        r.problem = problem;
+
+        r.arrivalTime = GetDevNodeTime(devInst, DEVPKEY_Device_LastArrivalDate);
+        r.removalTime = GetDevNodeTime(devInst, DEVPKEY_Device_LastRemovalDate);
+    }
+
+    // CM_LOCATE_DEVNODE_PHANTOM also finds devnodes that were just removed, so an unplug shows up
+    // as a presence change rather than a missing record, the same as in a full Survey.
+    bool Locate(const std::string& instanceId, DevnodeRecord& out) override
+    {
+        std::wstring wide(instanceId.begin(), instanceId.end());
+        DEVINST devInst = 0;
+        if (CM_Locate_DevNodeW(&devInst, wide.data(), CM_LOCATE_DEVNODE_PHANTOM) != CR_SUCCESS)
+            return false;
+
+        out = DevnodeRecord{};
+        out.handle = devInst;
+        SurveyDevInst(out);
+        return true;
+    }
+
+    void Fill(DevnodeRecord& r) override
+    {
+        DEVINST devInst = static_cast<DEVINST>(r.handle);
+
+        r.name = GetProperty(devInst, CM_DRP_FRIENDLYNAME);
+        if (r.name.empty())
+            r.name = GetProperty(devInst, CM_DRP_DEVICEDESC);
+        r.vendor = GetProperty(devInst, CM_DRP_MFG);
+        r.service = GetProperty(devInst, CM_DRP_SERVICE);
+
+        DWORD caps = 0;
+        ULONG size = sizeof(DWORD);
+        CM_Get_DevNode_Registry_PropertyW(devInst, CM_DRP_CAPABILITIES, nullptr, &caps, &size, 0);
+        r.capabilities = caps;
+    }
+};
+#elif defined(__linux__)
+// Reads /sys/bus/usb/devices, or a copy of it under root, for DevnodeSnapshot users on Linux;
+// USBDetector itself still needs WinHTTP and stays on SetupDi. Entries without a ':' are
+// usb_devices, the rest are their interfaces. sysfs only lists what is plugged in, so every record is present
+// and unplugged devices drop out of the snapshot instead of turning into phantoms. Arrival and
+// removal times are not available; devnum, which the kernel assigns afresh on every
+// enumeration, serves as the generation so a replug still counts as a change.
+// Each device is read through one directory fd: attributes are opened relative to it into a
+// stack buffer, so no path is built per attribute and nothing is allocated until the values
+// are copied into the record.
+struct SysfsDevnodeBackend : DevnodeBackend
+{
+    static constexpr uint32_t RemovableCapability = 0x00000004;  // CM_DEVCAP_REMOVABLE
+
+    std::string root = "/sys/bus/usb/devices";
+    int rootFd = -1;  // opened by the first Survey and kept for Fill and Locate
+
+    SysfsDevnodeBackend() = default;
+    explicit SysfsDevnodeBackend(std::string rootPath) : root(std::move(rootPath)) {}
+    SysfsDevnodeBackend(const SysfsDevnodeBackend&) = delete;
+    SysfsDevnodeBackend& operator=(const SysfsDevnodeBackend&) = delete;
+
+    ~SysfsDevnodeBackend()
+    {
+        if (rootFd >= 0)
+            close(rootFd);
+    }
+
+    // getdents64 records; the name runs on past the declared array up to d_reclen.
+    struct Dirent64
+    {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    // Reads one attribute relative to dirFd, dropping the trailing newline. Returns the length,
+    // 0 when the attribute is missing or empty.
+    static size_t ReadAttribute(int dirFd, const char* name, char* buf, size_t size)
+    {
+        int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return 0;
+        ssize_t n = read(fd, buf, size - 1);
+        close(fd);
+        if (n <= 0)
+            return 0;
+
+        size_t length = static_cast<size_t>(n);
+        while (length && (buf[length - 1] == '\n' || buf[length - 1] == '\0'))
+            --length;
+        buf[length] = '\0';
+        return length;
+    }
+
+    static unsigned ReadNumber(int dirFd, const char* name, int base)
+    {
+        char buf[32];
+        return ReadAttribute(dirFd, name, buf, sizeof(buf)) ? static_cast<unsigned>(strtoul(buf, nullptr, base)) : 0;
+    }
+
+    static std::string ReadString(int dirFd, const char* name)
+    {
+        char buf[256];
+        size_t length = ReadAttribute(dirFd, name, buf, sizeof(buf));
+        return std::string(buf, length);
+    }
+
+    // The Windows service names for the classes ClassifyLookup looks for, so records carry the
+    // same service values on both platforms.
+    static const char* ServiceForClass(unsigned deviceClass)
+    {
+        switch (deviceClass)
+        {
+        case 0x03: return "HidUsb";
+        case 0x08: return "USBSTOR";
+        case 0x09: return "usbhub";
+        default: return "";
+        }
+    }
+
+    static std::string KernelName(const std::string& instanceId)
+    {
+        size_t slash = instanceId.rfind('\\');
+        return slash == std::string::npos ? instanceId : instanceId.substr(slash + 1);
+    }
+
+    int OpenDevice(const std::string& kernelName) const
+    {
+        return openat(rootFd, kernelName.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    static void SurveyDevice(int dirFd, const std::string& kernelName, DevnodeRecord& r)
+    {
+        unsigned vid = ReadNumber(dirFd, "idVendor", 16);
+        unsigned pid = ReadNumber(dirFd, "idProduct", 16);
+        r.instanceId = UsbInstanceId(vid, pid, kernelName);
+        r.generation = ReadNumber(dirFd, "devnum", 10);
+        r.present = true;
+    }
+
+    bool Survey(std::vector<DevnodeRecord>& out) override
+    {
+        if (rootFd < 0)
+            rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (rootFd < 0)
+            return false;
+
+        // A fresh descriptor per listing, so its read offset starts at the beginning.
+        int listFd = openat(rootFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (listFd < 0)
+            return false;
+
+        std::vector<std::string> names;
+        alignas(Dirent64) char buffer[32768];
+        for (;;)
+        {
+            long length = syscall(SYS_getdents64, listFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+            for (long offset = 0; offset < length;)
+            {
+                const Dirent64* entry = reinterpret_cast<const Dirent64*>(buffer + offset);
+                offset += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (name[0] != '.' && !strchr(name, ':'))
+                    names.emplace_back(name);
+            }
+        }
+        close(listFd);
+
+        out.assign(names.size(), DevnodeRecord{});
+        std::vector<char> found(names.size(), 0);
+        ParallelFor(names.size(), [&](size_t i)
+        {
+            int dirFd = OpenDevice(names[i]);
+            if (dirFd < 0)
+                return;
+            SurveyDevice(dirFd, names[i], out[i]);
+            close(dirFd);
+            found[i] = 1;
+        }, maxWorkers);
+
+        // Devices unplugged between the listing and the reads.
+        size_t kept = 0;
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            if (!found[i])
+                continue;
+            if (kept != i)
+                out[kept] = std::move(out[i]);
+            ++kept;
+        }
+        out.resize(kept);
+        return true;
+    }
+
+    // A different device now on the same port has a different id and is not a match; it comes
+    // with its own hotplug event.
+    bool Locate(const std::string& instanceId, DevnodeRecord& out) override
+    {
+        if (rootFd < 0)
+            return false;
+
+        std::string kernelName = KernelName(instanceId);
+        int dirFd = OpenDevice(kernelName);
+        if (dirFd < 0)
+            return false;
+
+        out = DevnodeRecord{};
+        SurveyDevice(dirFd, kernelName, out);
+        close(dirFd);
+        return out.instanceId == instanceId;
+    }
+
+    void Fill(DevnodeRecord& r) override
+    {
+        std::string kernelName = KernelName(r.instanceId);
+        int dirFd = OpenDevice(kernelName);
+        if (dirFd < 0)
+            return;
+
+        r.name = ReadString(dirFd, "product");
+        r.vendor = ReadString(dirFd, "manufacturer");
+
+        char removable[32];
+        if (ReadAttribute(dirFd, "removable", removable, sizeof(removable)) && strcmp(removable, "removable") == 0)
+            r.capabilities |= RemovableCapability;
+
+        // Class 0 means each interface carries its own; the first one decides, as it does for
+        // the driver Windows loads for most composite devices.
+        unsigned deviceClass = ReadNumber(dirFd, "bDeviceClass", 16);
+        if (deviceClass == 0)
+        {
+            std::string firstInterface = kernelName + ":1.0/bInterfaceClass";
+            deviceClass = ReadNumber(dirFd, firstInterface.c_str(), 16);
+        }
+        r.service = ServiceForClass(deviceClass);
+
+        close(dirFd);
+    }
+};
+#endif
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <string_view>
+
+#include "providers.hpp"
+
+// USB/_usbids.hh is produced from a usb.ids snapshot by tools/usbids_to_header.py.
+#if __has_include("_usbids.hh")
+#include "_usbids.hh"
+#else
+#pragma message("USB/_usbids.hh not found: no embedded names, offline lookups use usb.ids and hwdb.bin only")
+#endif
+
+struct EmbeddedUsbIds : NameProvider
+{
+#ifdef USBIDS_EMBEDDED
+    // The pool is emitted as bytes; every name in it is NUL-terminated UTF-8.
+    static const char* NameAt(uint32_t offset)
+    {
+        return reinterpret_cast<const char*>(UsbIdsStrings) + offset;
+    }
+
+    static std::string_view FindVendor(uint16_t vid)
+    {
+        const uint16_t* first = std::begin(UsbIdsVendorKeys);
+        const uint16_t* last = std::end(UsbIdsVendorKeys);
+        const uint16_t* it = std::lower_bound(first, last, vid);
+        if (it == last || *it != vid)
+            return {};
+        return NameAt(UsbIdsVendorNames[it - first]);
+    }
+
+    static std::string_view FindDevice(uint32_t key)
+    {
+        const uint32_t* first = std::begin(UsbIdsDeviceKeys);
+        const uint32_t* last = std::end(UsbIdsDeviceKeys);
+        const uint32_t* it = std::lower_bound(first, last, key);
+        if (it == last || *it != key)
+            return {};
+        return NameAt(UsbIdsDeviceNames[it - first]);
+    }
+#else
+    static std::string_view FindVendor(uint16_t) { return {}; }
+    static std::string_view FindDevice(uint32_t) { return {}; }
+#endif
+
+    // Both names must be known for the table to stand in for a web lookup.
+    bool Lookup(uint32_t key, std::string_view& deviceName, std::string_view& vendorName) const override
+    {
+        deviceName = FindDevice(key);
+        vendorName = FindVendor(static_cast<uint16_t>(key >> 16));
+        return !deviceName.empty() && !vendorName.empty();
+    }
+};
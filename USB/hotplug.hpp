@@ -0,0 +1,329 @@
+﻿#pragma once
+#include "devnodes.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#include <cfgmgr32.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Devnodes that moved since the last batch, each id once in the order first seen.
+struct HotplugBatch
+{
+    std::vector<std::string> instanceIds;
+    size_t events = 0;       // raw notifications folded into this batch
+    bool overflow = false;   // notifications were lost, so only a full rescan is safe
+    std::chrono::steady_clock::time_point firstEvent{};
+};
+
+// Pulls the instance id out of one kernel uevent: an "action@devpath" header and then
+// NUL-terminated KEY=value pairs. Only usb_device events count; the interface events that
+// arrive alongside them describe the same device, so dropping them does the first round of
+// storm filtering for free.
+inline bool ParseUevent(const char* data, size_t length, std::string& instanceId)
+{
+    std::string_view subsystem, devType, devPath, product;
+    const char* end = data + length;
+    for (const char* p = data; p < end;)
+    {
+        const char* next = std::find(p, end, '\0');
+        std::string_view field(p, next - p);
+        if (field.compare(0, 10, "SUBSYSTEM=") == 0)
+            subsystem = field.substr(10);
+        else if (field.compare(0, 8, "DEVTYPE=") == 0)
+            devType = field.substr(8);
+        else if (field.compare(0, 8, "DEVPATH=") == 0)
+            devPath = field.substr(8);
+        else if (field.compare(0, 8, "PRODUCT=") == 0)
+            product = field.substr(8);
+        p = next + 1;
+    }
+
+    if (subsystem != "usb" || devType != "usb_device" || devPath.empty() || product.empty())
+        return false;
+
+    unsigned vid = 0, pid = 0;
+    if (sscanf(std::string(product).c_str(), "%x/%x", &vid, &pid) != 2)
+        return false;
+
+    size_t slash = devPath.rfind('/');
+    instanceId = UsbInstanceId(vid, pid, std::string(devPath.substr(slash == std::string_view::npos ? 0 : slash + 1)));
+    return true;
+}
+
+// Watches for USB devnodes coming and going and hands them over in debounced batches. Plugging
+// in a hub or composite device fires a burst of notifications, so a batch is held until the
+// bus has been quiet for quietPeriod, but the first event in it never waits longer than
+// maxDelay. onBatch runs on the monitor's own thread.
+// Windows listens with CM_Register_Notification, Linux on a kernel uevent netlink socket.
+// Inject feeds a raw uevent through the same path, so the latency from event to updated
+// snapshot can be measured on Linux without plugging anything in.
+struct DeviceMonitor
+{
+    std::chrono::milliseconds quietPeriod{ 30 };
+    std::chrono::milliseconds maxDelay{ 250 };
+    std::function<void(HotplugBatch&)> onBatch;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    HotplugBatch pending;
+    std::unordered_set<std::string> pendingIds;
+    std::chrono::steady_clock::time_point lastEvent{};
+    bool stopping = false;
+    std::thread worker;
+
+    std::atomic<size_t> eventsReceived{ 0 };
+    std::atomic<size_t> batchesDelivered{ 0 };
+
+#ifdef _WIN32
+    HCMNOTIFICATION notification = nullptr;
+#elif defined(__linux__)
+    int socketFd = -1;
+    int stopPipe[2] = { -1, -1 };
+    std::thread reader;
+#endif
+
+    DeviceMonitor() = default;
+    DeviceMonitor(const DeviceMonitor&) = delete;
+    DeviceMonitor& operator=(const DeviceMonitor&) = delete;
+
+    ~DeviceMonitor()
+    {
+        Stop();
+    }
+
+    // Starts batching. False when the OS source could not be attached; batches from Inject are
+    // still delivered, and callers fall back to manual rescans.
+    bool Start(std::function<void(HotplugBatch&)> callback)
+    {
+        Stop();
+        onBatch = std::move(callback);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = false;
+        }
+        worker = std::thread([this]() { Run(); });
+        return Listen();
+    }
+
+    void Stop()
+    {
+        Unlisten();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    void Post(const std::string& instanceId, std::chrono::steady_clock::time_point received)
+    {
+        ++eventsReceived;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.events == 0 && !pending.overflow)
+                pending.firstEvent = received;
+            lastEvent = received;
+            ++pending.events;
+            if (pendingIds.insert(instanceId).second)
+                pending.instanceIds.push_back(instanceId);
+        }
+        wake.notify_all();
+    }
+
+    void PostOverflow()
+    {
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.events == 0 && !pending.overflow)
+                pending.firstEvent = now;
+            lastEvent = now;
+            pending.overflow = true;
+        }
+        wake.notify_all();
+    }
+
+    // Handles one raw uevent as if it had come from the socket. True when it was a USB device.
+    bool Inject(const char* data, size_t length)
+    {
+        auto received = std::chrono::steady_clock::now();
+        std::string instanceId;
+        if (!ParseUevent(data, length, instanceId))
+            return false;
+        Post(instanceId, received);
+        return true;
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [&]() { return stopping || pending.events != 0 || pending.overflow; });
+            if (stopping)
+                return;
+
+            for (;;)
+            {
+                auto due = std::min(lastEvent + quietPeriod, pending.firstEvent + maxDelay);
+                if (stopping || std::chrono::steady_clock::now() >= due)
+                    break;
+                wake.wait_until(lock, due);
+            }
+            if (stopping)
+                return;
+
+            HotplugBatch batch = std::move(pending);
+            pending = HotplugBatch{};
+            pendingIds.clear();
+
+            lock.unlock();
+            ++batchesDelivered;
+            if (onBatch)
+                onBatch(batch);
+            lock.lock();
+        }
+    }
+
+#ifdef _WIN32
+    static DWORD CALLBACK OnNotification(HCMNOTIFICATION, void* context, CM_NOTIFY_ACTION action, PCM_NOTIFY_EVENT_DATA data, DWORD)
+    {
+        if (action != CM_NOTIFY_ACTION_DEVICEINSTANCEENUMERATED && action != CM_NOTIFY_ACTION_DEVICEINSTANCESTARTED &&
+            action != CM_NOTIFY_ACTION_DEVICEINSTANCEREMOVED)
+            return ERROR_SUCCESS;
+
+        // Same scope as the scan: devnodes under the USB enumerator.
+        std::string instanceId = WideToUtf8(data->u.DeviceInstance.InstanceId);
+        if (instanceId.size() < 4 || _strnicmp(instanceId.c_str(), "USB\\", 4) != 0)
+            return ERROR_SUCCESS;
+
+        static_cast<DeviceMonitor*>(context)->Post(instanceId, std::chrono::steady_clock::now());
+        return ERROR_SUCCESS;
+    }
+
+    bool Listen()
+    {
+        CM_NOTIFY_FILTER filter{};
+        filter.cbSize = sizeof(filter);
+        filter.Flags = CM_NOTIFY_FILTER_FLAG_ALL_DEVICE_INSTANCES;
+        filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINSTANCE;
+        return CM_Register_Notification(&filter, this, OnNotification, &notification) == CR_SUCCESS;
+    }
+
+    // Blocks until callbacks already running have returned.
+    void Unlisten()
+    {
+        if (notification)
+        {
+            CM_Unregister_Notification(notification);
+            notification = nullptr;
+        }
+    }
+#elif defined(__linux__)
+    bool Listen()
+    {
+        socketFd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (socketFd < 0)
+            return false;
+
+        // A storm can outrun the reader; a bigger buffer makes ENOBUFS, and the full rescan it
+        // forces, rarer. The kernel caps this at rmem_max.
+        int bufferSize = 1 << 20;
+        setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+        sockaddr_nl address{};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = 1;  // kernel events, not udev's rebroadcast
+        if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || pipe2(stopPipe, O_CLOEXEC) != 0)
+        {
+            Unlisten();
+            return false;
+        }
+
+        reader = std::thread([this]() { Read(); });
+        return true;
+    }
+
+    void Read()
+    {
+        char buffer[8192];
+        pollfd fds[2] = { { socketFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        for (;;)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            if (fds[1].revents)
+                return;
+
+            sockaddr_nl sender{};
+            iovec io{ buffer, sizeof(buffer) };
+            msghdr message{};
+            message.msg_name = &sender;
+            message.msg_namelen = sizeof(sender);
+            message.msg_iov = &io;
+            message.msg_iovlen = 1;
+
+            ssize_t length = recvmsg(socketFd, &message, MSG_DONTWAIT);
+            if (length < 0)
+            {
+                if (errno == ENOBUFS)
+                    PostOverflow();
+                continue;
+            }
+            // Only the kernel may speak on group 1; anything else is spoofed.
+            if (sender.nl_pid != 0)
+                continue;
+            Inject(buffer, static_cast<size_t>(length));
+        }
+    }
+
+    void Unlisten()
+    {
+        if (reader.joinable())
+        {
+            ssize_t ignored = write(stopPipe[1], "x", 1);
+            (void)ignored;
+            reader.join();
+        }
+        for (int* fd : { &socketFd, &stopPipe[0], &stopPipe[1] })
+        {
+            if (*fd >= 0)
+                close(*fd);
+            *fd = -1;
+        }
+    }
+#else
+    bool Listen()
+    {
+        return false;
+    }
+
+    void Unlisten()
+    {
+    }
+#endif
+};
@@ -0,0 +1,341 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if !defined(HTMLSCAN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define HTMLSCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Candidate filter over every marker still being searched for. A position survives when, for
+// some marker, both its first and its last byte line up there; with SSE2 sixteen positions are
+// tested per step. Survivors still have to be verified against the full marker.
+struct MarkerFilter
+{
+    static constexpr size_t kMaxVectorMarkers = 8;
+
+    std::string_view markers[kMaxVectorMarkers];
+    size_t count = 0;
+    size_t longest = 0;
+    bool firstByte[256] = {};
+
+    void Clear()
+    {
+        count = 0;
+        longest = 0;
+        std::fill(std::begin(firstByte), std::end(firstByte), false);
+    }
+
+    // Markers must be non-empty.
+    void Add(std::string_view marker)
+    {
+        if (count < kMaxVectorMarkers)
+            markers[count] = marker;
+        ++count;
+        longest = std::max(longest, marker.size());
+        firstByte[static_cast<uint8_t>(marker[0])] = true;
+    }
+
+    static unsigned LowestSetBit(unsigned mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    // First candidate position at or after from, or npos.
+    size_t Next(std::string_view data, size_t from) const
+    {
+        size_t pos = from;
+#if defined(HTMLSCAN_SSE2)
+        if (count > 0 && count <= kMaxVectorMarkers)
+        {
+            __m128i first[kMaxVectorMarkers];
+            __m128i last[kMaxVectorMarkers];
+            for (size_t i = 0; i < count; ++i)
+            {
+                first[i] = _mm_set1_epi8(markers[i].front());
+                last[i] = _mm_set1_epi8(markers[i].back());
+            }
+
+            // Every load, including the one shifted to a marker's last byte, stays inside data.
+            while (pos + 16 + longest - 1 <= data.size())
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.data() + pos));
+                __m128i hits = _mm_setzero_si128();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.data() + pos + markers[i].size() - 1));
+                    hits = _mm_or_si128(hits, _mm_and_si128(_mm_cmpeq_epi8(block, first[i]), _mm_cmpeq_epi8(tail, last[i])));
+                }
+
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+                if (mask)
+                    return pos + LowestSetBit(mask);
+                pos += 16;
+            }
+        }
+#endif
+        for (; pos < data.size(); ++pos)
+        {
+            if (firstByte[static_cast<uint8_t>(data[pos])])
+                return pos;
+        }
+        return std::string_view::npos;
+    }
+};
+
+// Incremental marker extraction over a growing response buffer. Each Feed only looks at the
+// bytes that arrived since the last call (plus a marker-sized overlap for matches that straddle
+// a chunk boundary), so the caller can stop the transfer once every field has been captured.
+// All fields are searched in one sweep: the begin and end markers still outstanding share one
+// MarkerFilter, and each field only accepts matches at or after its own searchFrom, so the
+// result is the same as searching every field separately.
+struct HtmlFieldScanner
+{
+    struct Field
+    {
+        std::string_view begin;
+        std::string_view end;
+        size_t searchFrom = 0;
+        size_t valueStart = std::string_view::npos;
+        size_t valueEnd = std::string_view::npos;
+
+        bool Done() const
+        {
+            return valueEnd != std::string_view::npos;
+        }
+    };
+
+    std::vector<Field> fields;
+
+    size_t Add(std::string_view begin, std::string_view end)
+    {
+        Field field;
+        field.begin = begin;
+        field.end = end;
+        fields.push_back(field);
+        return fields.size() - 1;
+    }
+
+    static size_t Resume(size_t dataSize, size_t markerSize, size_t floor)
+    {
+        size_t resume = dataSize >= markerSize ? dataSize - markerSize + 1 : 0;
+        return resume > floor ? resume : floor;
+    }
+
+    static std::string_view Pending(const Field& field)
+    {
+        return field.valueStart == std::string_view::npos ? field.begin : field.end;
+    }
+
+    // Loads the filter with the marker each unfinished field is waiting for. Returns the lowest
+    // position any of them may match at, or npos when every field is done.
+    size_t BuildFilter(MarkerFilter& filter) const
+    {
+        filter.Clear();
+        size_t from = std::string_view::npos;
+        for (const Field& field : fields)
+        {
+            if (field.Done())
+                continue;
+            filter.Add(Pending(field));
+            from = std::min(from, field.searchFrom);
+        }
+        return from;
+    }
+
+    // data is everything received so far. Returns true once every field is complete.
+    bool Feed(std::string_view data)
+    {
+        MarkerFilter filter;
+        size_t pos = BuildFilter(filter);
+
+        while (pos != std::string_view::npos && (pos = filter.Next(data, pos)) != std::string_view::npos)
+        {
+            bool changed = false;
+            for (Field& field : fields)
+            {
+                if (field.Done() || pos < field.searchFrom)
+                    continue;
+
+                std::string_view marker = Pending(field);
+                if (data.compare(pos, marker.size(), marker) != 0)
+                    continue;
+
+                if (field.valueStart == std::string_view::npos)
+                {
+                    field.valueStart = pos + marker.size();
+                    field.searchFrom = field.valueStart;
+                }
+                else
+                {
+                    field.valueEnd = pos;
+                }
+                changed = true;
+            }
+
+            // A field moving from its begin to its end marker changes what is being looked for.
+            if (changed && BuildFilter(filter) == std::string_view::npos)
+                break;
+            ++pos;
+        }
+
+        bool allDone = true;
+        for (Field& field : fields)
+        {
+            if (field.Done())
+                continue;
+
+            field.searchFrom = Resume(data.size(), Pending(field).size(), field.searchFrom);
+            allDone = false;
+        }
+        return allDone;
+    }
+
+    std::string_view Value(std::string_view data, size_t index) const
+    {
+        const Field& field = fields[index];
+        if (!field.Done())
+            return {};
+
+        std::string_view value = data.substr(field.valueStart, field.valueEnd - field.valueStart);
+        const char* whitespace = " \t\n\r\f\v";
+        size_t start = value.find_first_not_of(whitespace);
+        if (start == std::string_view::npos)
+            return {};
+        return value.substr(start, value.find_last_not_of(whitespace) - start + 1);
+    }
+};
+
+// Device names from a devicehunt vendor listing, where every device row links to
+// .../vendor/VVVV/device/PPPP with the device name as the link text. Like HtmlFieldScanner it
+// is fed the growing body and only looks at new bytes, and it reports when every PID the
+// caller asked for has been seen.
+struct VendorListingParser
+{
+    uint16_t vid = 0;
+    std::map<uint16_t, std::string> wanted;
+    size_t found = 0;
+    size_t scanFrom = 0;
+
+    static int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool ParseHex4(std::string_view text, uint16_t& value)
+    {
+        if (text.size() < 4)
+            return false;
+
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            int d = HexDigit(text[i]);
+            if (d < 0) return false;
+            value = static_cast<uint16_t>((value << 4) | d);
+        }
+        return true;
+    }
+
+    void Want(uint16_t pid)
+    {
+        wanted.emplace(pid, std::string());
+    }
+
+    bool Complete() const
+    {
+        return found == wanted.size();
+    }
+
+    // Link text, skipping over a few wrapping tags such as <span> or <strong>. Returns false if
+    // the text is not fully buffered yet.
+    static bool LinkText(std::string_view data, size_t tagEnd, std::string_view& text)
+    {
+        for (int depth = 0; depth < 4; ++depth)
+        {
+            size_t textEnd = data.find('<', tagEnd + 1);
+            if (textEnd == std::string_view::npos)
+                return false;
+
+            text = data.substr(tagEnd + 1, textEnd - tagEnd - 1);
+            size_t start = text.find_first_not_of(" \t\n\r\f\v");
+            if (start != std::string_view::npos)
+            {
+                text = text.substr(start, text.find_last_not_of(" \t\n\r\f\v") - start + 1);
+                return true;
+            }
+
+            if (data.substr(textEnd, 2) == "</")
+                break;
+            tagEnd = data.find('>', textEnd);
+            if (tagEnd == std::string_view::npos)
+                return false;
+        }
+
+        text = {};
+        return true;
+    }
+
+    bool Feed(std::string_view data)
+    {
+        static constexpr std::string_view vendorPart = "/vendor/";
+        static constexpr std::string_view devicePart = "/device/";
+
+        while (!Complete())
+        {
+            size_t pos = data.find(devicePart, scanFrom);
+            if (pos == std::string_view::npos)
+            {
+                scanFrom = HtmlFieldScanner::Resume(data.size(), devicePart.size(), scanFrom);
+                return false;
+            }
+
+            size_t idStart = pos + devicePart.size();
+            size_t tagEnd = data.find('>', idStart);
+            std::string_view text;
+            if (tagEnd == std::string_view::npos || !LinkText(data, tagEnd, text))
+            {
+                scanFrom = pos;
+                return false;
+            }
+            scanFrom = idStart;
+
+            uint16_t linkVid = 0, pid = 0;
+            const size_t vidLength = vendorPart.size() + 4;
+            if (pos < vidLength || data.substr(pos - vidLength, vendorPart.size()) != vendorPart ||
+                !ParseHex4(data.substr(pos - 4, 4), linkVid) || linkVid != vid || !ParseHex4(data.substr(idStart, 4), pid))
+                continue;
+
+            auto it = wanted.find(pid);
+            if (it != wanted.end() && it->second.empty() && !text.empty())
+            {
+                it->second = std::string(text);
+                ++found;
+            }
+        }
+        return true;
+    }
+
+    std::string Name(uint16_t pid) const
+    {
+        auto it = wanted.find(pid);
+        return it != wanted.end() ? it->second : std::string();
+    }
+};
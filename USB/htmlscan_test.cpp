@@ -0,0 +1,107 @@
+﻿// Fuzzes HtmlFieldScanner against ExtractHtmlValue, the one-shot find/find/trim extraction it
+// replaced: random pages built from marker fragments, fed in random chunks, must give the same
+// value for every field. Run it on both filter paths, from the repo root:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I. USB/htmlscan_test.cpp -o htmlscan_test && ./htmlscan_test
+//   g++ -std=c++17 -O2 -Wall -Wextra -DHTMLSCAN_NO_SIMD -I. USB/htmlscan_test.cpp -o htmlscan_test && ./htmlscan_test
+// An optional argument sets the number of cases.
+#include "htmlscan.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static std::string ExtractHtmlValue(const std::string& html, const std::string& begin, const std::string& end)
+{
+    size_t posStart = html.find(begin);
+    if (posStart == std::string::npos) return "";
+    posStart += begin.length();
+    size_t posEnd = html.find(end, posStart);
+    if (posEnd == std::string::npos) return "";
+
+    std::string value = html.substr(posStart, posEnd - posStart);
+    const char* whitespace = " \t\n\r\f\v";
+    size_t start = value.find_first_not_of(whitespace);
+    if (start == std::string::npos) return "";
+    return value.substr(start, value.find_last_not_of(whitespace) - start + 1);
+}
+
+int main(int argc, char** argv)
+{
+    size_t cases = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    std::mt19937 rng(12345);
+    auto below = [&](size_t n) { return static_cast<size_t>(rng() % n); };
+
+    // The live page markers, plus short overlapping ones that repeat and straddle chunks often.
+    const std::vector<std::pair<std::string, std::string>> markerPool = {
+        { "details__heading'>", "</h3><table" },
+        { "details --type-vendor --auto-link\"><h3 class='details__heading'>", "</h3><table" },
+        { "<a>", "</a>" },
+        { "aa", "ab" },
+        { "<h3", "<" },
+        { "x", "xx" },
+        { "</h3>", "<table" },
+        { "heading'>", "</" },
+        { "a", "b" },
+        { "ab", "a" },
+    };
+    const char* filler[] = { " ", "\n", "a", "b", "x", "<", ">", "'", "h3", "\t", "Name", "</h3>", "<table" };
+
+    size_t failures = 0;
+    for (size_t n = 0; n < cases && failures < 10; ++n)
+    {
+        // Up to ten fields, so the scalar path past kMaxVectorMarkers gets exercised as well.
+        std::vector<std::pair<std::string, std::string>> markers;
+        size_t fieldCount = 1 + below(10);
+        for (size_t i = 0; i < fieldCount; ++i)
+            markers.push_back(markerPool[below(markerPool.size())]);
+
+        std::string page;
+        size_t pieces = below(60);
+        for (size_t i = 0; i < pieces; ++i)
+        {
+            const auto& pair = markers[below(markers.size())];
+            switch (below(4))
+            {
+            case 0: page += pair.first; break;
+            case 1: page += pair.second; break;
+            case 2: page += pair.first.substr(0, below(pair.first.size() + 1)); break;
+            default: page += filler[below(sizeof(filler) / sizeof(filler[0]))]; break;
+            }
+        }
+
+        HtmlFieldScanner scanner;
+        for (const auto& pair : markers)
+            scanner.Add(pair.first, pair.second);
+
+        // Feed growing prefixes, the way response chunks arrive; stop early like the client does.
+        size_t received = 0;
+        bool done = false;
+        while (!done && received < page.size())
+        {
+            received = std::min(page.size(), received + 1 + below(24));
+            done = scanner.Feed(std::string_view(page).substr(0, received));
+        }
+        if (!done)
+            scanner.Feed(page);
+
+        for (size_t i = 0; i < markers.size(); ++i)
+        {
+            std::string expected = ExtractHtmlValue(page, markers[i].first, markers[i].second);
+            std::string_view actual = scanner.Value(page, i);
+            if (actual != expected)
+            {
+                printf("FAIL case %zu field %zu: \"%s\" vs expected \"%s\"\n  page: %s\n", n, i, std::string(actual).c_str(), expected.c_str(), page.c_str());
+                ++failures;
+            }
+        }
+    }
+
+#ifdef HTMLSCAN_SSE2
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    if (failures == 0)
+        printf("htmlscan_test (%s): %zu cases passed\n", path, cases);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,430 @@
+﻿#pragma once
+#include <windows.h>
+#include <winhttp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct HttpResponse
+{
+    DWORD statusCode = 0;
+    DWORD error = 0;
+    std::string body;
+    double elapsedMs = 0.0;
+    bool stoppedEarly = false;
+    bool cancelled = false;
+    DWORD retryAfterSeconds = 0;  // only the delta-seconds form of Retry-After is understood
+    DWORD contentLength = 0;      // as sent, i.e. compressed; 0 when the server chunked the reply
+    size_t wireBytes = 0;         // body bytes actually received before decompression, best estimate
+    std::string etag;
+    std::string lastModified;
+};
+
+// Asynchronous WinHttp client. Every request is a small state machine driven by WinHttp's
+// completion callbacks, so one dispatching thread can keep many lookups in flight without a
+// blocked thread per request. The session (and with it WinHttp's keep-alive socket pool) is
+// shared by every request for the lifetime of the client.
+struct HttpClient
+{
+    struct Request
+    {
+        HttpClient* client = nullptr;
+        uint64_t id = 0;
+        HINTERNET handle = nullptr;
+        std::function<void(HttpResponse&)> onComplete;
+        std::function<bool(std::string_view)> onChunk;
+        std::wstring headers;
+        std::chrono::steady_clock::time_point started;
+        HttpResponse response;
+        size_t pendingRead = 0;
+        size_t drained = 0;
+        bool completed = false;  // onComplete already ran; the rest of the body is being drained
+        bool closing = false;
+    };
+
+    HINTERNET session = nullptr;
+    std::map<std::wstring, HINTERNET> connections;  // by host:port
+    std::map<uint64_t, Request*> active;
+    uint64_t nextId = 1;
+    std::mutex mutex;
+    std::condition_variable idleCv;
+    std::atomic<size_t> handshakes{ 0 };
+    std::atomic<size_t> bufferGrowths{ 0 };  // body reallocations, and the bytes they had to move
+    std::atomic<size_t> bytesCopied{ 0 };
+    std::atomic<size_t> drainedStops{ 0 };  // early stops whose connection went back to the pool
+    std::vector<std::string> bufferPool;
+    size_t initialBufferSize = 32 * 1024;
+    size_t maxPooledBufferSize = 1024 * 1024;
+    size_t maxDrainBytes = 64 * 1024;
+    DWORD maxConnectionsPerHost = 32;
+    int resolveTimeoutMs = 5000;
+    int connectTimeoutMs = 5000;
+    int sendTimeoutMs = 5000;
+    int receiveTimeoutMs = 8000;
+
+    HttpClient() = default;
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    ~HttpClient()
+    {
+        Close();
+    }
+
+    bool Open()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (session)
+            return true;
+
+        session = WinHttpOpen(L"USBDetector", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+        if (!session)
+            return false;
+
+        WinHttpSetTimeouts(session, resolveTimeoutMs, connectTimeoutMs, sendTimeoutMs, receiveTimeoutMs);
+        WinHttpSetOption(session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &maxConnectionsPerHost, sizeof(maxConnectionsPerHost));
+
+        // WinHttp advertises gzip/deflate and inflates as it reads, so onChunk still sees plain
+        // HTML while the wire carries a fraction of it. Older systems just reject the option.
+        DWORD decompression = WINHTTP_DECOMPRESSION_FLAG_ALL;
+        WinHttpSetOption(session, WINHTTP_OPTION_DECOMPRESSION, &decompression, sizeof(decompression));
+        WinHttpSetStatusCallback(session, &HttpClient::StatusCallback, WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES | WINHTTP_CALLBACK_FLAG_CONNECTED_TO_SERVER, 0);
+        return true;
+    }
+
+    // Cancels whatever is still in flight and waits for WinHttp to release every request.
+    void Close()
+    {
+        std::vector<HINTERNET> cancelled;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto& entry : active)
+        {
+            Request* request = entry.second;
+            if (!request->closing)
+            {
+                request->closing = true;
+                request->response.cancelled = true;
+                cancelled.push_back(request->handle);
+            }
+        }
+
+        // HANDLE_CLOSING can be delivered on this thread, so the lock is dropped while closing.
+        lock.unlock();
+        for (HINTERNET handle : cancelled)
+            WinHttpCloseHandle(handle);
+        lock.lock();
+
+        idleCv.wait(lock, [&]() { return active.empty(); });
+
+        for (auto& host : connections)
+            WinHttpCloseHandle(host.second);
+        connections.clear();
+
+        if (session)
+        {
+            WinHttpSetStatusCallback(session, nullptr, 0, 0);
+            WinHttpCloseHandle(session);
+            session = nullptr;
+        }
+    }
+
+    // Returns 0 if the request could not be started; otherwise an id for Cancel, and onComplete runs
+    // exactly once, usually on a WinHttp thread. onChunk sees the body received so far after every
+    // read and can return true to stop early: onComplete runs right away and the rest of the body
+    // is read and dropped so the connection stays reusable. headers are extra CRLF-separated
+    // request headers, e.g. validators for a conditional GET.
+    uint64_t GetAsync(const std::wstring& host, INTERNET_PORT port, bool secure, const std::wstring& path, std::function<void(HttpResponse&)> onComplete, std::function<bool(std::string_view)> onChunk = nullptr, std::wstring headers = {})
+    {
+        if (!Open())
+            return 0;
+
+        Request* request = new Request();
+        request->client = this;
+        request->onComplete = std::move(onComplete);
+        request->onChunk = std::move(onChunk);
+        request->headers = std::move(headers);
+        request->started = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request->response.body = AcquireBuffer();
+            HINTERNET& connection = connections[host + L":" + std::to_wstring(port)];
+            if (!connection)
+                connection = WinHttpConnect(session, host.c_str(), port, 0);
+
+            request->handle = connection ? WinHttpOpenRequest(connection, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, secure ? WINHTTP_FLAG_SECURE : 0) : nullptr;
+            if (!request->handle)
+            {
+                delete request;
+                return 0;
+            }
+
+            // Set before sending so even a send that fails synchronously reaches HANDLE_CLOSING with its context.
+            DWORD_PTR context = reinterpret_cast<DWORD_PTR>(request);
+            WinHttpSetOption(request->handle, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context));
+            request->id = nextId++;
+            active[request->id] = request;
+        }
+
+        uint64_t id = request->id;
+        LPCWSTR extraHeaders = request->headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : request->headers.c_str();
+        if (!WinHttpSendRequest(request->handle, extraHeaders, static_cast<DWORD>(request->headers.size()), WINHTTP_NO_REQUEST_DATA, 0, 0, reinterpret_cast<DWORD_PTR>(request)))
+            Finish(request, GetLastError());
+
+        return id;
+    }
+
+    // Aborts a request that is still running; its onComplete sees response.cancelled. Unknown or
+    // already finished ids are ignored.
+    void Cancel(uint64_t id)
+    {
+        HINTERNET handle = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = active.find(id);
+            if (it == active.end() || it->second->closing)
+                return;
+            it->second->closing = true;
+            it->second->response.cancelled = true;
+            handle = it->second->handle;
+        }
+        WinHttpCloseHandle(handle);
+    }
+
+    // Closing the handle is the single exit; onComplete fires from HANDLE_CLOSING.
+    void Finish(Request* request, DWORD error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (request->closing)
+                return;
+            request->closing = true;
+        }
+
+        if (error && !request->response.error)
+            request->response.error = error;
+        WinHttpCloseHandle(request->handle);
+    }
+
+    void QueryData(Request* request)
+    {
+        if (!WinHttpQueryDataAvailable(request->handle, nullptr))
+            Finish(request, GetLastError());
+    }
+
+    // Caller holds the mutex. Bodies are read into recycled buffers, so after the first few
+    // lookups a page lands in memory that already has room for it.
+    std::string AcquireBuffer()
+    {
+        std::string buffer;
+        if (!bufferPool.empty())
+        {
+            buffer = std::move(bufferPool.back());
+            bufferPool.pop_back();
+            buffer.clear();
+        }
+        if (buffer.capacity() < initialBufferSize)
+            buffer.reserve(initialBufferSize);
+        return buffer;
+    }
+
+    // Caller holds the mutex. Oversized buffers are let go rather than pinned for the session.
+    void ReleaseBuffer(std::string&& buffer)
+    {
+        if (buffer.capacity() <= maxPooledBufferSize && bufferPool.size() < maxConnectionsPerHost)
+            bufferPool.push_back(std::move(buffer));
+    }
+
+    // Grows the body so another bytesAvailable fit without a reallocation in the read path.
+    void EnsureCapacity(std::string& body, size_t needed)
+    {
+        if (needed <= body.capacity())
+            return;
+
+        ++bufferGrowths;
+        bytesCopied += body.size();
+        body.reserve(std::max(needed, body.capacity() * 2));
+    }
+
+    // Validators are plain ASCII, so the wide header value is narrowed byte for byte.
+    static std::string QueryHeaderString(HINTERNET handle, DWORD query)
+    {
+        wchar_t value[128]{};
+        DWORD size = sizeof(value);
+        if (!WinHttpQueryHeaders(handle, query, WINHTTP_HEADER_NAME_BY_INDEX, value, &size, WINHTTP_NO_HEADER_INDEX))
+            return std::string();
+
+        std::string out;
+        for (size_t i = 0; i < size / sizeof(wchar_t); ++i)
+            out.push_back(static_cast<char>(value[i]));
+        return out;
+    }
+
+    void OnHeaders(Request* request)
+    {
+        DWORD statusCode = 0;
+        DWORD size = sizeof(statusCode);
+        WinHttpQueryHeaders(request->handle, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &statusCode, &size, WINHTTP_NO_HEADER_INDEX);
+        request->response.statusCode = statusCode;
+
+        DWORD contentLength = 0;
+        size = sizeof(contentLength);
+        if (WinHttpQueryHeaders(request->handle, WINHTTP_QUERY_CONTENT_LENGTH | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &contentLength, &size, WINHTTP_NO_HEADER_INDEX))
+            request->response.contentLength = contentLength;
+
+        // An uncompressed body is exactly Content-Length; a compressed one inflates past it, and
+        // doubling growth covers the rest.
+        if (contentLength)
+            EnsureCapacity(request->response.body, contentLength);
+
+        request->response.etag = QueryHeaderString(request->handle, WINHTTP_QUERY_ETAG);
+        request->response.lastModified = QueryHeaderString(request->handle, WINHTTP_QUERY_LAST_MODIFIED);
+
+        if (statusCode == 429 || statusCode == 503)
+        {
+            DWORD retryAfter = 0;
+            size = sizeof(retryAfter);
+            if (WinHttpQueryHeaders(request->handle, WINHTTP_QUERY_RETRY_AFTER | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &retryAfter, &size, WINHTTP_NO_HEADER_INDEX))
+                request->response.retryAfterSeconds = retryAfter;
+        }
+        QueryData(request);
+    }
+
+    void OnDataAvailable(Request* request, DWORD bytesAvailable)
+    {
+        if (bytesAvailable == 0)
+        {
+            Finish(request, 0);
+            return;
+        }
+
+        std::string& body = request->response.body;
+        if (request->completed)
+        {
+            // The parsed body is no longer needed, so its buffer takes the discarded bytes.
+            body.resize(std::min<size_t>(bytesAvailable, body.capacity()));
+            if (!WinHttpReadData(request->handle, &body[0], static_cast<DWORD>(body.size()), nullptr))
+                Finish(request, GetLastError());
+            return;
+        }
+
+        request->pendingRead = body.size();
+        EnsureCapacity(body, body.size() + bytesAvailable);
+        body.resize(body.size() + bytesAvailable);
+        if (!WinHttpReadData(request->handle, &body[request->pendingRead], bytesAvailable, nullptr))
+            Finish(request, GetLastError());
+    }
+
+    void OnReadComplete(Request* request, DWORD bytesRead)
+    {
+        HttpResponse& response = request->response;
+        if (request->completed)
+        {
+            request->drained += bytesRead;
+            if (bytesRead == 0)
+            {
+                ++drainedStops;
+                Finish(request, 0);
+            }
+            else if (request->drained > maxDrainBytes)
+                Finish(request, 0);
+            else
+                QueryData(request);
+            return;
+        }
+
+        response.body.resize(request->pendingRead + bytesRead);
+        if (bytesRead == 0)
+        {
+            Finish(request, 0);
+        }
+        else if (request->onChunk && request->onChunk(response.body))
+        {
+            response.stoppedEarly = true;
+            Complete(request);
+
+            // The body is inflated, so what is left on the wire is at least Content-Length minus
+            // what was read. Past the drain limit a new handshake is cheaper than reading on.
+            if (response.contentLength && response.contentLength > response.body.size() + maxDrainBytes)
+                Finish(request, 0);
+            else
+                QueryData(request);
+        }
+        else
+        {
+            QueryData(request);
+        }
+    }
+
+    void Complete(Request* request)
+    {
+        HttpResponse& response = request->response;
+        request->completed = true;
+        response.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request->started).count();
+
+        // With decompression on, the body is inflated text; Content-Length is the only view of the
+        // compressed size. An early stop received at most that much.
+        if (!response.contentLength)
+            response.wireBytes = response.body.size();
+        else
+            response.wireBytes = response.stoppedEarly ? std::min<size_t>(response.contentLength, response.body.size()) : response.contentLength;
+        request->onComplete(response);
+    }
+
+    void OnClosing(Request* request)
+    {
+        HttpResponse& response = request->response;
+        if (!request->completed)
+            Complete(request);
+
+        // onComplete is done with the body by now; the views it parsed are gone with it.
+        std::lock_guard<std::mutex> lock(mutex);
+        ReleaseBuffer(std::move(response.body));
+        active.erase(request->id);
+        delete request;
+        if (active.empty())
+            idleCv.notify_all();
+    }
+
+    static void CALLBACK StatusCallback(HINTERNET, DWORD_PTR context, DWORD status, LPVOID info, DWORD length)
+    {
+        Request* request = reinterpret_cast<Request*>(context);
+        if (!request)
+            return;
+
+        HttpClient* client = request->client;
+        switch (status)
+        {
+        case WINHTTP_CALLBACK_STATUS_CONNECTED_TO_SERVER:
+            ++client->handshakes;
+            break;
+        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            if (!WinHttpReceiveResponse(request->handle, nullptr))
+                client->Finish(request, GetLastError());
+            break;
+        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+            client->OnHeaders(request);
+            break;
+        case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE:
+            client->OnDataAvailable(request, *static_cast<DWORD*>(info));
+            break;
+        case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+            client->OnReadComplete(request, length);
+            break;
+        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+            client->Finish(request, static_cast<WINHTTP_ASYNC_RESULT*>(info)->dwError);
+            break;
+        case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+            client->OnClosing(request);
+            break;
+        }
+    }
+};
@@ -0,0 +1,202 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "mappedfile.hpp"
+#include "providers.hpp"
+
+// Reader for systemd's compiled hardware database (hwdb.bin). Lookups walk the trie straight
+// out of the mapping and hand back string_views into it, nothing is copied or allocated.
+struct HwdbFile : NameProvider
+{
+    struct Header
+    {
+        uint8_t signature[8];
+        uint64_t toolVersion;
+        uint64_t fileSize;
+        uint64_t headerSize;
+        uint64_t nodeSize;
+        uint64_t childEntrySize;
+        uint64_t valueEntrySize;
+        uint64_t nodesRootOff;
+        uint64_t nodesLen;
+        uint64_t stringsLen;
+    };
+
+    struct Node
+    {
+        uint64_t prefixOff;
+        uint8_t childrenCount;
+        uint8_t padding[7];
+        uint64_t valuesCount;
+    };
+
+    struct ChildEntry
+    {
+        uint8_t c;
+        uint8_t padding[7];
+        uint64_t childOff;
+    };
+
+    struct ValueEntry
+    {
+        uint64_t keyOff;
+        uint64_t valueOff;
+    };
+
+    static_assert(sizeof(Header) == 80 && sizeof(Node) == 24 && sizeof(ChildEntry) == 16 && sizeof(ValueEntry) == 16, "hwdb.bin on-disk layout");
+
+    MappedFile file;
+    Header header{};
+
+    bool IsOpen() const
+    {
+        return file.IsOpen();
+    }
+
+#ifdef _WIN32
+    // A hwdb.bin copied from a Linux box next to the executable or into %LOCALAPPDATA%\USBDetector.
+    bool OpenDefault()
+    {
+        wchar_t buf[MAX_PATH]{};
+        DWORD len = GetModuleFileNameW(nullptr, buf, MAX_PATH);
+        if (len > 0 && len < MAX_PATH)
+        {
+            std::wstring exePath(buf, len);
+            size_t slash = exePath.find_last_of(L"\\/");
+            if (slash != std::wstring::npos && Open(exePath.substr(0, slash + 1) + L"hwdb.bin"))
+                return true;
+        }
+
+        std::wstring dir = GetAppDataDirectory();
+        return !dir.empty() && Open(dir + L"\\hwdb.bin");
+    }
+
+    bool Open(const std::wstring& path)
+#else
+    bool OpenDefault()
+    {
+        return Open("/etc/udev/hwdb.bin") || Open("/usr/lib/udev/hwdb.bin");
+    }
+
+    bool Open(const std::string& path)
+#endif
+    {
+        if (!file.Open(path))
+            return false;
+
+        if (file.size < sizeof(Header))
+        {
+            file.Close();
+            return false;
+        }
+
+        memcpy(&header, file.data, sizeof(Header));
+        if (memcmp(header.signature, "KSLPHHRH", 8) != 0 || header.fileSize != file.size ||
+            header.nodeSize < sizeof(Node) || header.childEntrySize < sizeof(ChildEntry) || header.valueEntrySize < sizeof(ValueEntry) ||
+            header.nodesRootOff >= file.size)
+        {
+            file.Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ReadNode(uint64_t off, Node& node) const
+    {
+        if (off == 0 || off + header.nodeSize > file.size)
+            return false;
+        memcpy(&node, file.data + off, sizeof(Node));
+        return true;
+    }
+
+    std::string_view StringAt(uint64_t off) const
+    {
+        if (off == 0 || off >= file.size)
+            return {};
+        const char* s = file.data + off;
+        const void* nul = memchr(s, '\0', static_cast<size_t>(file.size - off));
+        return nul ? std::string_view(s, static_cast<size_t>(static_cast<const char*>(nul) - s)) : std::string_view();
+    }
+
+    // Children are stored sorted by character, so a binary search picks the next edge.
+    uint64_t FindChild(uint64_t nodeOff, const Node& node, uint8_t c) const
+    {
+        uint64_t base = nodeOff + header.nodeSize;
+        if (base + node.childrenCount * header.childEntrySize > file.size)
+            return 0;
+
+        int lo = 0, hi = static_cast<int>(node.childrenCount) - 1;
+        while (lo <= hi)
+        {
+            int mid = (lo + hi) / 2;
+            ChildEntry child;
+            memcpy(&child, file.data + base + mid * header.childEntrySize, sizeof(ChildEntry));
+            if (child.c == c) return child.childOff;
+            if (child.c < c) lo = mid + 1;
+            else hi = mid - 1;
+        }
+        return 0;
+    }
+
+    // Walks the trie for an exact match key (e.g. "usb:v046DpC52B*") and returns one of its properties.
+    std::string_view Find(std::string_view key, std::string_view property) const
+    {
+        if (!IsOpen())
+            return {};
+
+        uint64_t off = header.nodesRootOff;
+        size_t i = 0;
+        Node node;
+
+        while (ReadNode(off, node))
+        {
+            if (node.prefixOff)
+            {
+                std::string_view prefix = StringAt(node.prefixOff);
+                if (key.substr(i, prefix.size()) != prefix)
+                    return {};
+                i += prefix.size();
+            }
+
+            if (i == key.size())
+            {
+                uint64_t base = off + header.nodeSize + node.childrenCount * header.childEntrySize;
+                if (base + node.valuesCount * header.valueEntrySize > file.size)
+                    return {};
+
+                // systemd-hwdb stores property keys with a leading space and sd-hwdb ignores any
+                // key without one.
+                for (uint64_t v = 0; v < node.valuesCount; ++v)
+                {
+                    ValueEntry entry;
+                    memcpy(&entry, file.data + base + v * header.valueEntrySize, sizeof(ValueEntry));
+                    std::string_view entryKey = StringAt(entry.keyOff);
+                    if (!entryKey.empty() && entryKey[0] == ' ' && entryKey.substr(1) == property)
+                        return StringAt(entry.valueOff);
+                }
+                return {};
+            }
+
+            off = FindChild(off, node, static_cast<uint8_t>(key[i++]));
+        }
+
+        return {};
+    }
+
+    bool Lookup(uint32_t key, std::string_view& deviceName, std::string_view& vendorName) const override
+    {
+        char modalias[32];
+        snprintf(modalias, sizeof(modalias), "usb:v%04Xp%04X*", key >> 16, key & 0xFFFF);
+        deviceName = Find(modalias, "ID_MODEL_FROM_DATABASE");
+
+        snprintf(modalias, sizeof(modalias), "usb:v%04X*", key >> 16);
+        vendorName = Find(modalias, "ID_VENDOR_FROM_DATABASE");
+
+        return !deviceName.empty() && !vendorName.empty();
+    }
+};
@@ -0,0 +1,50 @@
+﻿// Lookups against USB/testdata/hwdb.bin, compiled by systemd-hwdb 252 from
+// USB/testdata/usb-sample.hwdb. From the repo root:
+//   g++ -std=c++17 -Wall -Wextra -I. USB/hwdb_test.cpp -o hwdb_test && ./hwdb_test
+#include "hwdb.hpp"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    HwdbFile hwdb;
+    if (!hwdb.Open(std::string(argc > 1 ? argv[1] : "USB/testdata/hwdb.bin")))
+    {
+        printf("FAIL: cannot open hwdb.bin\n");
+        return 1;
+    }
+
+    std::string_view device, vendor;
+    Check(hwdb.Lookup(0x046DC52B, device, vendor), "046d:c52b found");
+    Check(device == "Unifying Receiver", "046d:c52b model");
+    Check(vendor == "Logitech, Inc.", "046d:c52b vendor");
+
+    Check(hwdb.Lookup(0x07815567, device, vendor), "0781:5567 found");
+    Check(device == "Cruzer Blade" && vendor == "SanDisk Corp.", "0781:5567 names");
+
+    // Vendor known, product not: no match, but the vendor half still resolves.
+    Check(!hwdb.Lookup(0x80870001, device, vendor), "8087:0001 incomplete");
+    Check(device.empty() && vendor == "Intel Corp.", "8087:0001 vendor only");
+
+    Check(!hwdb.Lookup(0x12340001, device, vendor), "1234:0001 unknown");
+    Check(device.empty() && vendor.empty(), "1234:0001 empty");
+
+    // Keys are stored as " ID_MODEL_FROM_DATABASE"; callers pass the bare property name.
+    Check(hwdb.Find("usb:v046DpC077*", "ID_MODEL_FROM_DATABASE") == "M105 Optical Mouse", "bare property name");
+    Check(hwdb.Find("usb:v046DpC077*", " ID_MODEL_FROM_DATABASE").empty(), "spaced property name");
+
+    if (failures == 0)
+        printf("hwdb_test: all passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+﻿#pragma once
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file. The mapping stays valid until Close() or destruction.
+struct MappedFile
+{
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool Open(const std::wstring& path)
+    {
+        Close();
+
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize{};
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            Close();
+            return false;
+        }
+
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data)
+        {
+            Close();
+            return false;
+        }
+
+        size = static_cast<size_t>(fileSize.QuadPart);
+        return true;
+    }
+
+    void Close()
+    {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+        data = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        size = 0;
+    }
+#else
+    bool Open(const std::string& path)
+    {
+        Close();
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED)
+            return false;
+
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void Close()
+    {
+        if (data) munmap(const_cast<char*>(data), size);
+
+        data = nullptr;
+        size = 0;
+    }
+#endif
+
+    bool IsOpen() const
+    {
+        return data != nullptr;
+    }
+
+    std::string_view View() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+#ifdef _WIN32
+// %LOCALAPPDATA%\USBDetector, created on demand. Empty if the variable is not set.
+inline std::wstring GetAppDataDirectory()
+{
+    wchar_t buf[MAX_PATH]{};
+    DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH)
+        return {};
+
+    std::wstring dir = std::wstring(buf, len) + L"\\USBDetector";
+    CreateDirectoryW(dir.c_str(), nullptr);
+    return dir;
+}
+#endif
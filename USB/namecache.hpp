@@ -0,0 +1,360 @@
+﻿#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include "mappedfile.hpp"
+
+inline uint32_t PackVidPid(const std::string& vid, const std::string& pid)
+{
+    return (static_cast<uint32_t>(strtoul(vid.c_str(), nullptr, 16) & 0xFFFF) << 16) | (strtoul(pid.c_str(), nullptr, 16) & 0xFFFF);
+}
+
+enum class LookupOutcome : uint16_t
+{
+    Found          = 0,  // the page named the device and/or vendor
+    NotFound       = 1,  // the provider has no entry for this VID:PID
+    TransientError = 2,  // network failure, timeout, 429 or 5xx; retried with per-key backoff
+    ParseError     = 3,  // a page came back but neither name could be extracted from it
+};
+
+struct NameCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+// One fixed-size slot per VID:PID. The file is an append log of these, newest entry wins.
+struct NameCacheRecord
+{
+    uint32_t key;
+    LookupOutcome outcome;
+    uint16_t failures;
+    int64_t expires;
+    char deviceName[120];
+    char vendorName[120];
+    char etag[96];          // validators from the page that produced the names, for If-None-Match
+    char lastModified[32];  // and If-Modified-Since once the record has expired
+};
+
+static_assert(sizeof(NameCacheHeader) == 16, "NameCacheHeader layout is part of the file format");
+static_assert(sizeof(NameCacheRecord) == 384, "NameCacheRecord layout is part of the file format");
+
+struct NameCache
+{
+    static constexpr char kMagic[8] = { 'U', 'S', 'B', 'N', 'A', 'M', 'E', 'S' };
+    static constexpr uint32_t kVersion = 3;
+    static constexpr int64_t kFoundTtl = 30 * 24 * 3600;
+    static constexpr int64_t kNotFoundTtl = 90 * 24 * 3600;
+    static constexpr int64_t kParseErrorTtl = 6 * 3600;
+    static constexpr int64_t kBackoffBase = 5 * 60;
+    static constexpr int64_t kBackoffMax = 24 * 3600;
+    static constexpr int64_t kRevalidateWindow = 180 * 24 * 3600;
+
+    std::wstring path;
+    MappedFile mapped;
+    std::unordered_map<uint32_t, const NameCacheRecord*> index;
+    std::unordered_map<uint32_t, NameCacheRecord> added;
+    HANDLE appendHandle = INVALID_HANDLE_VALUE;
+    std::mutex mutex;
+    bool opened = false;
+
+    NameCache() = default;
+    NameCache(const NameCache&) = delete;
+    NameCache& operator=(const NameCache&) = delete;
+
+    ~NameCache()
+    {
+        if (appendHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(appendHandle);
+    }
+
+    static int64_t Now()
+    {
+        return static_cast<int64_t>(std::time(nullptr));
+    }
+
+    static bool IsValidFile(const MappedFile& file)
+    {
+        if (file.size < sizeof(NameCacheHeader))
+            return false;
+
+        const NameCacheHeader* header = reinterpret_cast<const NameCacheHeader*>(file.data);
+        return memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion && header->recordSize == sizeof(NameCacheRecord);
+    }
+
+    const NameCacheRecord* Records() const
+    {
+        return reinterpret_cast<const NameCacheRecord*>(mapped.data + sizeof(NameCacheHeader));
+    }
+
+    size_t RecordCount() const
+    {
+        return (mapped.size - sizeof(NameCacheHeader)) / sizeof(NameCacheRecord);
+    }
+
+    // A crash mid-append leaves part of a record at the end of the file.
+    bool HasTornTail() const
+    {
+        return mapped.IsOpen() && (mapped.size - sizeof(NameCacheHeader)) % sizeof(NameCacheRecord) != 0;
+    }
+
+    // Maps the cache file and indexes it in place; records are used straight from the mapping.
+    void Open()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (opened)
+            return;
+        opened = true;
+
+        std::wstring dir = GetAppDataDirectory();
+        if (dir.empty())
+            return;
+        path = dir + L"\\names.cache";
+
+        if (mapped.Open(path) && !IsValidFile(mapped))
+            mapped.Close();
+
+        BuildIndex();
+
+        if (mapped.IsOpen() && (HasTornTail() || index.size() * 2 < RecordCount() || CountExpired() * 2 > index.size()))
+            Compact();
+
+        if (!mapped.IsOpen())
+            CreateEmptyFile();
+
+        // Appending to a file that could not be rewritten (still torn, or not a cache file at all)
+        // would misalign every record after it. This session's results then stay in memory only.
+        if (!mapped.IsOpen() || HasTornTail())
+            return;
+
+        appendHandle = CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+
+    void BuildIndex()
+    {
+        index.clear();
+        if (!mapped.IsOpen())
+            return;
+
+        // Expired records stay indexed so a transient failure's count survives its backoff window;
+        // Find ignores them and compaction drops the ones that no longer matter.
+        const NameCacheRecord* records = Records();
+        size_t count = RecordCount();
+        for (size_t i = 0; i < count; ++i)
+            index[records[i].key] = &records[i];
+    }
+
+    static bool HasValidators(const NameCacheRecord& record)
+    {
+        return record.etag[0] != '\0' || record.lastModified[0] != '\0';
+    }
+
+    // How long a record is worth keeping past its expiry: a backing-off key needs its failure
+    // count, and an expired name with validators can still be revalidated for a few bytes.
+    static int64_t KeepUntil(const NameCacheRecord& record)
+    {
+        if (HasValidators(record) && record.outcome != LookupOutcome::NotFound)
+            return record.expires + kRevalidateWindow;
+        if (record.outcome == LookupOutcome::TransientError)
+            return record.expires + kBackoffMax;
+        return record.expires;
+    }
+
+    size_t CountExpired() const
+    {
+        int64_t now = Now();
+        size_t expired = 0;
+        for (const auto& entry : index)
+            expired += KeepUntil(*entry.second) <= now ? 1 : 0;
+        return expired;
+    }
+
+    static bool WriteFileWithHeader(const std::wstring& target, const std::vector<NameCacheRecord>& records)
+    {
+        HANDLE h = CreateFileW(target.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h == INVALID_HANDLE_VALUE)
+            return false;
+
+        NameCacheHeader header{};
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.recordSize = sizeof(NameCacheRecord);
+
+        DWORD written = 0;
+        bool ok = WriteFile(h, &header, sizeof(header), &written, nullptr) && written == sizeof(header);
+        if (ok && !records.empty())
+        {
+            DWORD bytes = static_cast<DWORD>(records.size() * sizeof(NameCacheRecord));
+            ok = WriteFile(h, records.data(), bytes, &written, nullptr) && written == bytes;
+        }
+        ok = ok && FlushFileBuffers(h);
+        CloseHandle(h);
+        return ok;
+    }
+
+    void CreateEmptyFile()
+    {
+        WriteFileWithHeader(path, {});
+        if (mapped.Open(path) && !IsValidFile(mapped))
+            mapped.Close();
+        BuildIndex();
+    }
+
+    // Rewrites only the live records to a temp file and swaps it in, so a crash leaves either file intact.
+    void Compact()
+    {
+        std::vector<NameCacheRecord> live;
+        live.reserve(index.size());
+        int64_t now = Now();
+        for (const auto& entry : index)
+        {
+            if (KeepUntil(*entry.second) > now)
+                live.push_back(*entry.second);
+        }
+
+        index.clear();
+        mapped.Close();
+
+        std::wstring tmpPath = path + L".tmp";
+        if (WriteFileWithHeader(tmpPath, live))
+            MoveFileExW(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+        else
+            DeleteFileW(tmpPath.c_str());
+
+        if (mapped.Open(path) && !IsValidFile(mapped))
+            mapped.Close();
+        BuildIndex();
+    }
+
+    // Latest record for the key, expired or not. Caller holds the mutex.
+    const NameCacheRecord* FindRecord(uint32_t key) const
+    {
+        auto addedIt = added.find(key);
+        if (addedIt != added.end())
+            return &addedIt->second;
+
+        auto it = index.find(key);
+        return it != index.end() ? it->second : nullptr;
+    }
+
+    // A live TransientError record means the key is still backing off; callers skip the lookup.
+    bool Find(uint32_t key, std::string& deviceName, std::string& vendorName, LookupOutcome& outcome)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const NameCacheRecord* record = FindRecord(key);
+        if (!record || record->expires <= Now())
+            return false;
+
+        outcome = record->outcome;
+        deviceName.assign(record->deviceName, strnlen(record->deviceName, sizeof(record->deviceName)));
+        vendorName.assign(record->vendorName, strnlen(record->vendorName, sizeof(record->vendorName)));
+        return true;
+    }
+
+    // An expired name that came with validators; the lookup can ask the provider whether it changed.
+    bool FindStale(uint32_t key, std::string& etag, std::string& lastModified)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const NameCacheRecord* record = FindRecord(key);
+        if (!record || record->outcome == LookupOutcome::NotFound || record->outcome == LookupOutcome::ParseError || !HasValidators(*record))
+            return false;
+
+        etag.assign(record->etag, strnlen(record->etag, sizeof(record->etag)));
+        lastModified.assign(record->lastModified, strnlen(record->lastModified, sizeof(record->lastModified)));
+        return true;
+    }
+
+    // The provider answered 304: the stored names are current for another full TTL.
+    bool Revalidate(uint32_t key, std::string& deviceName, std::string& vendorName)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const NameCacheRecord* previous = FindRecord(key);
+        if (!previous || !HasValidators(*previous))
+            return false;
+
+        NameCacheRecord record = *previous;
+        record.outcome = LookupOutcome::Found;
+        record.failures = 0;
+        record.expires = Now() + kFoundTtl;
+        deviceName.assign(record.deviceName, strnlen(record.deviceName, sizeof(record.deviceName)));
+        vendorName.assign(record.vendorName, strnlen(record.vendorName, sizeof(record.vendorName)));
+        Append(record);
+        return true;
+    }
+
+    void Append(const NameCacheRecord& record)
+    {
+        added[record.key] = record;
+
+        // A single record-sized append is the unit of durability; a torn tail is dropped on load.
+        if (appendHandle != INVALID_HANDLE_VALUE)
+        {
+            DWORD written = 0;
+            WriteFile(appendHandle, &record, sizeof(record), &written, nullptr);
+        }
+    }
+
+    // Longest prefix of name that fits in limit bytes without splitting a UTF-8 sequence: if the
+    // first byte cut off is a continuation byte, the code point it belongs to goes too.
+    static size_t Utf8PrefixLength(const std::string& name, size_t limit)
+    {
+        if (name.size() <= limit)
+            return name.size();
+
+        size_t length = limit;
+        while (length > 0 && (static_cast<unsigned char>(name[length]) & 0xC0) == 0x80)
+            --length;
+        return length;
+    }
+
+    void Store(uint32_t key, LookupOutcome outcome, const std::string& deviceName, const std::string& vendorName, const std::string& etag = {}, const std::string& lastModified = {})
+    {
+        NameCacheRecord record{};
+        record.key = key;
+        record.outcome = outcome;
+        record.expires = Now() + (outcome == LookupOutcome::Found ? kFoundTtl : outcome == LookupOutcome::NotFound ? kNotFoundTtl : kParseErrorTtl);
+        memcpy(record.deviceName, deviceName.data(), Utf8PrefixLength(deviceName, sizeof(record.deviceName) - 1));
+        memcpy(record.vendorName, vendorName.data(), Utf8PrefixLength(vendorName, sizeof(record.vendorName) - 1));
+        if (etag.size() < sizeof(record.etag))
+            memcpy(record.etag, etag.data(), etag.size());
+        if (lastModified.size() < sizeof(record.lastModified))
+            memcpy(record.lastModified, lastModified.data(), lastModified.size());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Append(record);
+    }
+
+    // Each consecutive transient failure doubles how long the key is left alone, up to a day.
+    void StoreFailure(uint32_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const NameCacheRecord* previous = FindRecord(key);
+        uint16_t failures = (previous && previous->outcome == LookupOutcome::TransientError) ? previous->failures : 0;
+        if (failures < 16)
+            ++failures;
+
+        // Names and validators from an earlier success ride along, so the key can still be shown
+        // and revalidated once the backoff is over.
+        NameCacheRecord record{};
+        if (previous && (previous->outcome == LookupOutcome::Found || previous->outcome == LookupOutcome::TransientError))
+            record = *previous;
+        record.key = key;
+        record.outcome = LookupOutcome::TransientError;
+        record.failures = failures;
+        record.expires = Now() + std::min(kBackoffMax, kBackoffBase << (failures - 1));
+        Append(record);
+    }
+};
@@ -0,0 +1,167 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Names resolved for one VID:PID. Entries are immutable once published; an update publishes a
+// new entry instead of editing the old one.
+struct NameEntry
+{
+    std::string DeviceName;
+    std::string VendorName;
+};
+
+// Read-mostly map from packed VID:PID to names. Lookups take no lock: each shard publishes an
+// open-addressing table through an atomic pointer, slots are written value first and key second,
+// and readers only ever see fully built entries. Writers serialize per shard. Replaced entries
+// and outgrown tables are retired, not freed, until the map itself goes away; a scan writes at
+// most one entry per distinct device, so that garbage stays small.
+struct ConcurrentNameMap
+{
+    static constexpr size_t kShards = 16;
+    static constexpr size_t kInitialSlots = 64;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> tag{ 0 };  // 0 = empty, otherwise kOccupied | key
+        std::atomic<const NameEntry*> entry{ nullptr };
+    };
+
+    struct Table
+    {
+        size_t mask = 0;
+        size_t used = 0;
+        std::unique_ptr<Slot[]> slots;
+
+        explicit Table(size_t size) : mask(size - 1), slots(new Slot[size]) {}
+    };
+
+    struct Shard
+    {
+        std::atomic<Table*> table{ nullptr };
+        std::mutex writeMutex;
+        std::vector<std::unique_ptr<Table>> tables;
+        std::vector<std::unique_ptr<const NameEntry>> entries;
+    };
+
+    static constexpr uint64_t kOccupied = uint64_t(1) << 32;
+
+    std::array<Shard, kShards> shards;
+
+    ConcurrentNameMap() = default;
+    ConcurrentNameMap(const ConcurrentNameMap&) = delete;
+    ConcurrentNameMap& operator=(const ConcurrentNameMap&) = delete;
+
+    static uint32_t Hash(uint32_t key)
+    {
+        // Murmur3 finalizer; VID:PIDs of one vendor differ only in the low bits.
+        key ^= key >> 16;
+        key *= 0x85EBCA6B;
+        key ^= key >> 13;
+        key *= 0xC2B2AE35;
+        key ^= key >> 16;
+        return key;
+    }
+
+    Shard& ShardFor(uint32_t hash)
+    {
+        return shards[hash & (kShards - 1)];
+    }
+
+    const Shard& ShardFor(uint32_t hash) const
+    {
+        return shards[hash & (kShards - 1)];
+    }
+
+    // Lock-free. The entry stays valid for the lifetime of the map.
+    const NameEntry* Find(uint32_t key) const
+    {
+        uint32_t hash = Hash(key);
+        const Table* table = ShardFor(hash).table.load(std::memory_order_acquire);
+        if (!table)
+            return nullptr;
+
+        uint64_t wanted = kOccupied | key;
+        for (size_t i = (hash >> 4) & table->mask;; i = (i + 1) & table->mask)
+        {
+            uint64_t tag = table->slots[i].tag.load(std::memory_order_acquire);
+            if (tag == wanted)
+                return table->slots[i].entry.load(std::memory_order_acquire);
+            if (tag == 0)
+                return nullptr;
+        }
+    }
+
+    // Storing names identical to the current entry is a no-op, so rescans do not pile up garbage.
+    void Store(uint32_t key, std::string deviceName, std::string vendorName)
+    {
+        uint32_t hash = Hash(key);
+        Shard& shard = ShardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+
+        const NameEntry* current = Find(key);
+        if (current && current->DeviceName == deviceName && current->VendorName == vendorName)
+            return;
+
+        shard.entries.push_back(std::make_unique<const NameEntry>(NameEntry{ std::move(deviceName), std::move(vendorName) }));
+        const NameEntry* entry = shard.entries.back().get();
+
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        if (!table || (table->used + 1) * 2 > table->mask + 1)
+            table = Grow(shard, table);
+
+        Insert(*table, hash, key, entry);
+    }
+
+    // Caller holds the shard's write lock.
+    static bool Insert(Table& table, uint32_t hash, uint32_t key, const NameEntry* entry)
+    {
+        uint64_t wanted = kOccupied | key;
+        for (size_t i = (hash >> 4) & table.mask;; i = (i + 1) & table.mask)
+        {
+            Slot& slot = table.slots[i];
+            uint64_t tag = slot.tag.load(std::memory_order_relaxed);
+            if (tag == wanted)
+            {
+                slot.entry.store(entry, std::memory_order_release);
+                return false;
+            }
+            if (tag == 0)
+            {
+                slot.entry.store(entry, std::memory_order_relaxed);
+                slot.tag.store(wanted, std::memory_order_release);
+                ++table.used;
+                return true;
+            }
+        }
+    }
+
+    // Builds a table twice the size from the current one and publishes it. Readers still probing
+    // the old table finish there; it is kept alive with the shard.
+    static Table* Grow(Shard& shard, Table* current)
+    {
+        size_t size = current ? (current->mask + 1) * 2 : kInitialSlots;
+        shard.tables.push_back(std::make_unique<Table>(size));
+        Table* next = shard.tables.back().get();
+
+        if (current)
+        {
+            for (size_t i = 0; i <= current->mask; ++i)
+            {
+                uint64_t tag = current->slots[i].tag.load(std::memory_order_relaxed);
+                if (tag != 0)
+                {
+                    uint32_t key = static_cast<uint32_t>(tag);
+                    Insert(*next, Hash(key), key, current->slots[i].entry.load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+        shard.table.store(next, std::memory_order_release);
+        return next;
+    }
+};
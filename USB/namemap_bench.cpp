@@ -0,0 +1,129 @@
+﻿// Contention benchmark for ConcurrentNameMap against the mutex-guarded std::map it replaced.
+// Each thread runs a scan-like mix over 2,000 VID:PIDs: mostly reads, with one store in sixteen,
+// as when enumeration reads names while lookups land. From the repo root:
+//   g++ -std=c++17 -O2 -Wall -Wextra -pthread -I. USB/namemap_bench.cpp -o namemap_bench && ./namemap_bench
+#include "namemap.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+struct LockedNameMap
+{
+    std::map<uint32_t, NameEntry> names;
+    std::mutex mutex;
+
+    bool Find(uint32_t key, NameEntry& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = names.find(key);
+        if (it == names.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+
+    void Store(uint32_t key, std::string deviceName, std::string vendorName)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        names[key] = NameEntry{ std::move(deviceName), std::move(vendorName) };
+    }
+};
+
+static constexpr size_t kKeys = 2000;
+static constexpr size_t kOpsPerThread = 200000;
+
+static uint32_t KeyAt(size_t i)
+{
+    return static_cast<uint32_t>((0x1000 + i / 16) << 16 | (i % 16));
+}
+
+// Names carry their key, so a reader can tell a torn or misplaced entry from a good one.
+static std::string DeviceName(uint32_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "Device %08X", key);
+    return name;
+}
+
+template <typename Op>
+static double Run(size_t threads, Op op)
+{
+    auto start = Clock::now();
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&, t]()
+        {
+            uint32_t state = static_cast<uint32_t>(t * 2654435761u + 1);
+            for (size_t i = 0; i < kOpsPerThread; ++i)
+            {
+                state = state * 1664525u + 1013904223u;
+                op(KeyAt((state >> 8) % kKeys), (state >> 28) == 0);
+            }
+        });
+    }
+    for (std::thread& thread : pool)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return threads * kOpsPerThread / seconds / 1e6;
+}
+
+int main()
+{
+    printf("threads  locked map  name map  (million ops/s, 1 in 16 a store)\n");
+    for (size_t threads : { 1, 2, 4, 8 })
+    {
+        LockedNameMap locked;
+        double lockedRate = Run(threads, [&](uint32_t key, bool store)
+        {
+            NameEntry entry;
+            if (store)
+                locked.Store(key, DeviceName(key), "Vendor");
+            else
+                locked.Find(key, entry);
+        });
+
+        ConcurrentNameMap names;
+        std::atomic<size_t> torn{ 0 };
+        double mapRate = Run(threads, [&](uint32_t key, bool store)
+        {
+            if (store)
+            {
+                names.Store(key, DeviceName(key), "Vendor");
+                return;
+            }
+            const NameEntry* entry = names.Find(key);
+            if (entry && entry->DeviceName != DeviceName(key))
+                ++torn;
+        });
+        Check(torn == 0, "readers only see the entry stored for their key");
+
+        size_t found = 0;
+        for (size_t i = 0; i < kKeys; ++i)
+        {
+            const NameEntry* entry = names.Find(KeyAt(i));
+            found += entry && entry->DeviceName == DeviceName(KeyAt(i)) ? 1 : 0;
+        }
+        Check(found > kKeys * 9 / 10, "stores are visible once the writers are done");
+        printf("%7zu  %10.1f  %8.1f\n", threads, lockedRate, mapRate);
+    }
+
+    if (failures == 0)
+        printf("namemap_bench: all passed\n");
+    return failures == 0 ? 0 : 1;
+}
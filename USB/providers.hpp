@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A source that can name a VID:PID synchronously from local data (embedded table, usb.ids,
+// hwdb.bin). Returns true only when it knows both names.
+struct NameProvider
+{
+    virtual ~NameProvider() = default;
+    virtual bool Lookup(uint32_t key, std::string_view& deviceName, std::string_view& vendorName) const = 0;
+};
+
+// Sliding window of recent request latencies, used to decide when a lookup is slow enough that
+// a hedged request is worth its cost.
+struct LatencyTracker
+{
+    std::vector<double> samples;
+    size_t next = 0;
+    size_t capacity = 256;
+
+    void Add(double ms)
+    {
+        if (samples.size() < capacity)
+            samples.push_back(ms);
+        else
+            samples[next] = ms;
+        next = (next + 1) % capacity;
+    }
+
+    size_t Count() const
+    {
+        return samples.size();
+    }
+
+    double Percentile(double p) const
+    {
+        if (samples.empty())
+            return 0.0;
+
+        std::vector<double> sorted = samples;
+        size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+};
+
+// A devicehunt-compatible web source. The first one is the primary; a second one on another host
+// receives the hedged requests. With no such second source lookups are not hedged, since a copy
+// sent to the same host only adds to its load.
+struct WebProvider
+{
+    std::wstring host;
+    uint16_t port = 443;
+    bool secure = true;  // HTTPS; a plain-HTTP mirror sets this false along with its port
+    LatencyTracker latency;
+    double defaultHedgeMs = 1500.0;
+    size_t minSamples = 20;
+
+    explicit WebProvider(std::wstring h, uint16_t p = 443, bool tls = true) : host(std::move(h)), port(p), secure(tls) {}
+
+    std::wstring DevicePath(const std::string& vid, const std::string& pid) const
+    {
+        return L"/view/type/usb/vendor/" + std::wstring(vid.begin(), vid.end()) + L"/device/" + std::wstring(pid.begin(), pid.end());
+    }
+
+    std::wstring VendorPath(const std::string& vid) const
+    {
+        return L"/view/type/usb/vendor/" + std::wstring(vid.begin(), vid.end());
+    }
+
+    // Until enough samples exist the p95 is a guess, so a fixed delay is used instead.
+    double HedgeDelayMs() const
+    {
+        return latency.Count() < minSamples ? defaultHedgeMs : latency.Percentile(0.95);
+    }
+};
@@ -0,0 +1,164 @@
+﻿#pragma once
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+// Retries are paid for out of a shared budget: every first attempt deposits a fraction of a
+// token and each retry withdraws a whole one, so a struggling provider sees at most that
+// fraction of extra load instead of a retry storm.
+struct RetryBudget
+{
+    double tokens = 0.0;
+    double depositPerRequest = 0.2;
+    double reserve = 3.0;
+    double maxTokens = 20.0;
+
+    void Reset()
+    {
+        tokens = reserve;
+    }
+
+    void OnRequest()
+    {
+        tokens = std::min(maxTokens, tokens + depositPerRequest);
+    }
+
+    bool TryWithdraw()
+    {
+        if (tokens < 1.0)
+            return false;
+        tokens -= 1.0;
+        return true;
+    }
+};
+
+// Classic closed / open / half-open breaker. After failureThreshold consecutive failures it
+// rejects calls for the cooldown, then lets a single probe through to decide whether to close.
+struct CircuitBreaker
+{
+    enum class State { Closed, Open, HalfOpen };
+
+    using Clock = std::chrono::steady_clock;
+
+    State state = State::Closed;
+    int consecutiveFailures = 0;
+    int failureThreshold = 5;
+    std::chrono::milliseconds cooldown{ 30000 };
+    Clock::time_point openedAt{};
+    bool probeInFlight = false;
+
+    bool Allow(Clock::time_point now = Clock::now())
+    {
+        if (state == State::Open && now - openedAt >= cooldown)
+        {
+            state = State::HalfOpen;
+            probeInFlight = false;
+        }
+
+        if (state == State::Closed)
+            return true;
+
+        if (state == State::HalfOpen && !probeInFlight)
+        {
+            probeInFlight = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    void OnSuccess()
+    {
+        state = State::Closed;
+        consecutiveFailures = 0;
+        probeInFlight = false;
+    }
+
+    // A result that says nothing about the host's health (throttled, cancelled). It still ends
+    // a half-open probe, so the next call can try again instead of waiting forever.
+    void OnNeutral()
+    {
+        probeInFlight = false;
+    }
+
+    void OnFailure(Clock::time_point now = Clock::now())
+    {
+        ++consecutiveFailures;
+        if (state == State::HalfOpen || consecutiveFailures >= failureThreshold)
+        {
+            state = State::Open;
+            openedAt = now;
+            probeInFlight = false;
+        }
+    }
+};
+
+// Per-host politeness limiter. Tokens refill at ratePerSecond up to burst; a request needs one.
+// A 429/503 pauses the host for its Retry-After and halves the rate, which then creeps back up
+// by a fraction of a request per second on each success.
+struct TokenBucket
+{
+    using Clock = std::chrono::steady_clock;
+
+    double ratePerSecond = 8.0;
+    double minRate = 0.5;
+    double maxRate = 8.0;
+    double recoveryStep = 0.25;
+    double burst = 4.0;
+    double tokens = 4.0;
+    Clock::time_point lastRefill = Clock::now();
+    Clock::time_point pausedUntil{};
+
+    void Refill(Clock::time_point now)
+    {
+        double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+        if (elapsed > 0.0)
+            tokens = std::min(burst, tokens + elapsed * ratePerSecond);
+        lastRefill = now;
+    }
+
+    bool TryTake(Clock::time_point now = Clock::now())
+    {
+        if (now < pausedUntil)
+            return false;
+        Refill(now);
+        if (tokens < 1.0)
+            return false;
+        tokens -= 1.0;
+        return true;
+    }
+
+    // Earliest moment TryTake can succeed; now if a token is already available.
+    Clock::time_point NextToken(Clock::time_point now = Clock::now())
+    {
+        if (now < pausedUntil)
+            return pausedUntil;
+        Refill(now);
+        if (tokens >= 1.0)
+            return now;
+        auto wait = std::chrono::duration<double>((1.0 - tokens) / ratePerSecond);
+        // Rounded up, so a dispatcher sleeping until then finds the token there.
+        return now + std::chrono::ceil<Clock::duration>(wait);
+    }
+
+    void OnThrottled(std::chrono::seconds retryAfter, Clock::time_point now = Clock::now())
+    {
+        ratePerSecond = std::max(minRate, ratePerSecond * 0.5);
+        tokens = 0.0;
+        lastRefill = now;
+        pausedUntil = std::max(pausedUntil, now + std::max(retryAfter, std::chrono::seconds(1)));
+    }
+
+    void OnSuccess()
+    {
+        ratePerSecond = std::min(maxRate, ratePerSecond + recoveryStep);
+    }
+};
+
+// Full-jitter exponential backoff: a uniform delay in [0, min(cap, base * 2^attempt)].
+inline std::chrono::milliseconds JitteredBackoff(int attempt, std::mt19937& rng, std::chrono::milliseconds base = std::chrono::milliseconds(250), std::chrono::milliseconds cap = std::chrono::milliseconds(4000))
+{
+    long long ceiling = std::min<long long>(cap.count(), base.count() << std::min(attempt, 16));
+    std::uniform_int_distribution<long long> dist(0, ceiling);
+    return std::chrono::milliseconds(dist(rng));
+}
@@ -13,8 +13,27 @@
 #include <numeric>
 #include <thread>
 #include <mutex>
-#include <queue>
+#include <deque>
 #include <condition_variable>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "namecache.hpp"
+#include "embeddedids.hpp"
+#include "usbidsfile.hpp"
+#include "hwdb.hpp"
+#include "httpclient.hpp"
+#include "htmlscan.hpp"
+#include "aimd.hpp"
+#include "resilience.hpp"
+#include "providers.hpp"
+#include "namemap.hpp"
+#include "devnodes.hpp"
+#include "hotplug.hpp"
 
 struct USBDeviceInfo
 {
@@ -31,37 +50,282 @@ struct USBDeviceInfo
     bool isConnected = false;
 };
 
+// Lower is looked up sooner. Long-removed phantoms go last: nobody is waiting on their names.
+enum class LookupPriority : uint8_t
+{
+    ConnectedStorage,  // connected mass-storage or HID, the usual suspects
+    Visible,           // currently on screen in the device table
+    Connected,
+    Removed,
+    Phantom,           // not seen for more than phantomAge, or never
+    Count
+};
+
 struct LookupTask
 {
     std::string vid;
     std::string pid;
     std::string key;
+    uint32_t packedKey = 0;
+    int attempt = 0;
+    bool noBatch = false;
+    uint64_t scanId = 0;  // the scan that queued it; its stats get the outcome even if it lands late
+    LookupPriority priority = LookupPriority::Connected;
+    std::string etag{};        // set when an expired cache entry can be revalidated
+    std::string lastModified{};
+    std::chrono::steady_clock::time_point notBefore{};
+};
+
+// Multi-level FIFO: a task always leaves from the most important non-empty level, and tasks of
+// the same level keep their discovery order.
+struct LookupQueue
+{
+    std::array<std::deque<LookupTask>, static_cast<size_t>(LookupPriority::Count)> levels;
+    size_t count = 0;
+
+    bool Empty() const
+    {
+        return count == 0;
+    }
+
+    void Push(const LookupTask& task)
+    {
+        levels[static_cast<size_t>(task.priority)].push_back(task);
+        ++count;
+    }
+
+    LookupTask Pop()
+    {
+        for (auto& level : levels)
+        {
+            if (!level.empty())
+            {
+                LookupTask task = std::move(level.front());
+                level.pop_front();
+                --count;
+                return task;
+            }
+        }
+        return LookupTask{};
+    }
+
+    template <typename Pred>
+    size_t CountIf(Pred pred) const
+    {
+        size_t n = 0;
+        for (const auto& level : levels)
+            n += std::count_if(level.begin(), level.end(), pred);
+        return n;
+    }
+
+    template <typename Pred>
+    void ExtractIf(Pred pred, std::vector<LookupTask>& out)
+    {
+        for (auto& level : levels)
+        {
+            for (auto it = level.begin(); it != level.end();)
+            {
+                if (pred(*it))
+                {
+                    out.push_back(std::move(*it));
+                    it = level.erase(it);
+                    --count;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    // Moves a queued key up to the given level; never demotes.
+    void Raise(const std::string& key, LookupPriority priority)
+    {
+        std::vector<LookupTask> moved;
+        ExtractIf([&](const LookupTask& task) { return task.key == key && task.priority > priority; }, moved);
+        for (LookupTask& task : moved)
+        {
+            task.priority = priority;
+            Push(task);
+        }
+    }
+};
+
+struct LookupStats
+{
+    double enumerateMs = 0.0;
+    size_t devnodes = 0;
+    size_t devnodesFilled = 0;  // devnodes whose full properties were read this scan
+    size_t devnodesAdded = 0;
+    size_t devnodesChanged = 0;
+    size_t devnodesRemoved = 0;
+    size_t hotplugEvents = 0;
+    double hotplugMs = 0.0;     // first hotplug event in the batch to the finished device list
+    size_t queued = 0;
+    size_t deduplicated = 0;
+    size_t tableHits = 0;
+    size_t diskHits = 0;
+    size_t httpRequests = 0;
+    size_t handshakes = 0;
+    size_t drainedStops = 0;  // early stops that kept their connection
+    size_t bytesRead = 0;
+    size_t wireBytes = 0;
+    size_t bufferGrowths = 0;
+    size_t bytesCopied = 0;
+    size_t stoppedEarly = 0;
+    double lookupMillis = 0.0;
+    size_t timeouts = 0;
+    size_t retries = 0;
+    size_t breakerRejections = 0;
+    size_t unresolvedAtDeadline = 0;
+    size_t notFound = 0;
+    size_t parseErrors = 0;
+    size_t backoffSkips = 0;
+    size_t vendorBatches = 0;
+    size_t batchResolved = 0;
+    size_t hedgesSent = 0;
+    size_t hedgeWins = 0;
+    size_t throttled = 0;
+    size_t priorityQueued = 0;
+    size_t revalidations = 0;
+    size_t notModified = 0;
+    double firstRelevantMs = 0.0;  // scan start to the first connected storage/HID name
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+};
+
+// One device lookup that may be racing a hedged copy of itself. Whichever request settles it
+// first wins; the other is cancelled.
+struct HedgedLookup
+{
+    LookupTask task;
+    std::mutex mutex;
+    uint64_t requestIds[2] = { 0, 0 };
+    int outstanding = 0;
+    bool hedged = false;
+    bool settled = false;
+    std::chrono::steady_clock::time_point started{};
+    std::chrono::steady_clock::time_point hedgeAt{};
 };
 
 struct USBDetector
 {
-    std::map<std::string, USBDeviceInfo> deviceCache;
-    std::mutex cacheMutex;
-    std::queue<LookupTask> lookupQueue;
+    ConcurrentNameMap resolvedNames;
+    std::unique_ptr<DevnodeBackend> devnodes = std::make_unique<SetupDiDevnodeBackend>();
+    DevnodeSnapshot snapshot;
+    DevnodeDelta lastDelta;
+    NameCache nameCache;
+    HttpClient http;
+    UsbIdsFile usbIdsFile;
+    HwdbFile hwdb;
+    EmbeddedUsbIds embeddedIds;
+    std::vector<const NameProvider*> localProviders;
+    std::once_flag offlineSourcesOnce;
+    std::vector<WebProvider> webProviders{ WebProvider(L"devicehunt.com") };
+    std::vector<std::shared_ptr<HedgedLookup>> hedgeTimers;
+    std::map<std::wstring, TokenBucket> hostLimiters;
+    LatencyTracker scanLatency;
+    LookupQueue lookupQueue;
+    std::set<std::string> visibleKeys;
+    std::chrono::steady_clock::time_point scanStarted{};
+    std::map<std::string, std::vector<LookupTask>> vendorBatches;
+    size_t vendorBatchThreshold = 3;
+    // Off until VendorListingParser has been checked against a saved devicehunt vendor page; the
+    // listing markup it expects is inferred from the device page links, not captured.
+    bool vendorBatching = false;
+    std::set<std::string> inFlightKeys;
+    LookupStats scanStats;  // the scan in progress, scanId
+    std::map<uint64_t, LookupStats> pastScans;  // the last few, still collecting late answers
+    LookupStats agedOutStats;  // late answers for scans that fell out of pastScans
+    uint64_t scanId = 0;
+    size_t maxPastScans = 4;
+    std::atomic<uint64_t> namesVersion{ 0 };  // bumped whenever a lookup settles
     std::mutex queueMutex;
     std::condition_variable cv;
+    std::condition_variable idleCv;
+    size_t pendingLookups = 0;
+    size_t activeLookups = 0;
+    size_t maxInFlight = 32;
+    AimdController concurrency;
+    std::vector<LookupTask> delayedLookups;
+    RetryBudget retryBudget;
+    CircuitBreaker breaker;
+    std::mt19937 rng{ std::random_device{}() };
+    std::chrono::milliseconds scanBudget{ 15000 };
+    std::chrono::steady_clock::time_point scanDeadline{};
     bool done = false;
-    std::vector<std::thread> workers;
+    std::thread dispatcher;
 
-    std::string WideToUtf8(const std::wstring& w)
+    ~USBDetector()
     {
-        if (w.empty()) return {};
-        int size = WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, nullptr, 0, nullptr, nullptr);
-        std::string s(size - 1, 0);
-        WideCharToMultiByte(CP_UTF8, 0, w.c_str(), -1, s.data(), size, nullptr, nullptr);
-        return s;
+        StopDispatcher();
+        http.Close();
     }
 
-    std::string FileTimeToString(const FILETIME& ft)
+    // The dispatcher lives across scans; lookups start as soon as GetDeviceInfo queues them.
+    void StartDispatcher()
     {
-        if (!ft.dwLowDateTime && !ft.dwHighDateTime)
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (dispatcher.joinable())
+            return;
+
+        done = false;
+        concurrency.SetCeiling(maxInFlight);
+        dispatcher = std::thread(&USBDetector::LookupDispatcher, this);
+    }
+
+    void StopDispatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            done = true;
+        }
+        cv.notify_all();
+        idleCv.notify_all();
+
+        if (dispatcher.joinable())
+            dispatcher.join();
+    }
+
+    // Returns at the scan deadline even if lookups are still outstanding; those devices keep their
+    // SetupDi names for this scan and the late answers land in the caches for the next one.
+    void WaitForLookups()
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        if (!idleCv.wait_until(lock, scanDeadline, [&]() { return pendingLookups == 0 || done; }))
+            scanStats.unresolvedAtDeadline = pendingLookups;
+    }
+
+    // Caller holds queueMutex. Where a lookup's counters go: the scan that queued it, which may
+    // have been superseded by the time its answer arrives.
+    LookupStats& StatsFor(uint64_t id)
+    {
+        if (id == scanId)
+            return scanStats;
+        auto it = pastScans.find(id);
+        return it != pastScans.end() ? it->second : agedOutStats;
+    }
+
+    // A copy taken under queueMutex, so it can be read while lookups are still landing. Keyed by
+    // scan id; the last entry is the scan in progress.
+    std::map<uint64_t, LookupStats> StatsSnapshot()
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        std::map<uint64_t, LookupStats> snapshot = pastScans;
+        snapshot[scanId] = scanStats;
+        return snapshot;
+    }
+
+    std::string FileTimeToString(uint64_t ticks)
+    {
+        if (!ticks)
             return "";
 
+        FILETIME ft{};
+        ft.dwLowDateTime = static_cast<DWORD>(ticks);
+        ft.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+
         SYSTEMTIME utc{}, local{};
         FileTimeToSystemTime(&ft, &utc);
         SystemTimeToTzSpecificLocalTime(nullptr, &utc, &local);
@@ -71,14 +335,6 @@ struct USBDetector
         return buf;
     }
 
-    bool GetDevNodeTime(DEVINST devInst, const DEVPROPKEY& key, FILETIME& out)
-    {
-        DEVPROPTYPE type;
-        ULONG size = sizeof(FILETIME);
-        memset(&out, 0, sizeof(FILETIME));
-        return CM_Get_DevNode_PropertyW(devInst, &key, &type, (PBYTE)&out, &size, 0) == CR_SUCCESS && type == DEVPROP_TYPE_FILETIME;
-    }
-
     std::string CapabilitiesToString(DWORD caps)
     {
         std::vector<std::string> out;
@@ -95,238 +351,817 @@ struct USBDetector
             [](const std::string& a, const std::string& b) { return a.empty() ? b : a + ", " + b; });
     }
 
-    std::string StringTrim(const std::string& str)
+    void FinishLookup(const LookupTask& task)
     {
-        const char* whitespace = " \t\n\r\f\v";
-        size_t start = str.find_first_not_of(whitespace);
-        size_t end = str.find_last_not_of(whitespace);
-        if (start == std::string::npos || end == std::string::npos)
-            return "";
-        return str.substr(start, end - start + 1);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (task.scanId == scanId && task.priority == LookupPriority::ConnectedStorage && scanStats.firstRelevantMs == 0.0)
+                scanStats.firstRelevantMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanStarted).count();
+            inFlightKeys.erase(task.key);
+            if (pendingLookups > 0 && --pendingLookups == 0)
+                idleCv.notify_all();
+        }
+        ++namesVersion;
+        cv.notify_one();
+    }
+
+    struct PageScanner
+    {
+        HtmlFieldScanner scanner;
+        size_t deviceField = scanner.Add("details__heading'>", "</h3><table");
+        size_t vendorField = scanner.Add("details --type-vendor --auto-link\"><h3 class='details__heading'>", "</h3><table");
+    };
+
+    // Feeds one finished request into the stats, the concurrency window and the breaker.
+    // Caller holds queueMutex. Returns true if the request failed in a retryable way.
+    bool RecordResponse(const std::wstring& host, const HttpResponse& response, LookupStats& stats)
+    {
+        bool missing = response.statusCode == 404 || response.statusCode == 410;
+        bool failed = response.error != 0 || response.statusCode == 0 || (response.statusCode >= 400 && !missing);
+
+        if (activeLookups > 0)
+            --activeLookups;
+        stats.bytesRead += response.body.size();
+        stats.wireBytes += response.wireBytes;
+        stats.notModified += response.statusCode == 304 ? 1 : 0;
+
+        // A request we aborted ourselves says nothing about the provider's health.
+        if (response.cancelled)
+        {
+            breaker.OnNeutral();
+            return true;
+        }
+
+        stats.stoppedEarly += response.stoppedEarly ? 1 : 0;
+        stats.lookupMillis += response.elapsedMs;
+        concurrency.OnResult(response.elapsedMs, !failed);
+
+        // Being told to slow down is the limiter's business; the host itself is healthy, so the
+        // breaker does not count it.
+        if (response.statusCode == 429 || response.statusCode == 503)
+        {
+            LimiterFor(host).OnThrottled(std::chrono::seconds(response.retryAfterSeconds));
+            breaker.OnNeutral();
+            ++stats.throttled;
+        }
+        else if (!failed)
+        {
+            LimiterFor(host).OnSuccess();
+            breaker.OnSuccess();
+        }
+        else
+        {
+            breaker.OnFailure();
+            if (response.error == ERROR_WINHTTP_TIMEOUT)
+                ++stats.timeouts;
+        }
+        return failed;
     }
 
-    std::string ExtractHtmlValue(const std::string& html, const std::string& begin, const std::string& end)
+    // Starts one of the (at most two) requests racing for a hedged lookup.
+    void StartLookupRequest(const std::shared_ptr<HedgedLookup>& lookup, int slot, size_t provider)
     {
-        size_t posStart = html.find(begin);
-        if (posStart == std::string::npos) return "";
-        posStart += begin.length();
-        size_t posEnd = html.find(end, posStart);
-        if (posEnd == std::string::npos) return "";
-        return StringTrim(html.substr(posStart, posEnd - posStart));
+        const LookupTask& task = lookup->task;
+        auto page = std::make_shared<PageScanner>();
+
+        std::wstring headers;
+        if (!task.etag.empty())
+            headers += L"If-None-Match: " + std::wstring(task.etag.begin(), task.etag.end()) + L"\r\n";
+        if (!task.lastModified.empty())
+            headers += L"If-Modified-Since: " + std::wstring(task.lastModified.begin(), task.lastModified.end()) + L"\r\n";
+
+        // Both names sit near the top of the page; the rest of the download is skipped once they are in.
+        const WebProvider& source = webProviders[provider];
+        uint64_t id = http.GetAsync(source.host, source.port, source.secure, source.DevicePath(task.vid, task.pid),
+            [this, lookup, slot, provider, page](HttpResponse& response) { OnLookupResponse(lookup, slot, provider, response, *page); },
+            [page](std::string_view body) { return page->scanner.Feed(body); },
+            std::move(headers));
+
+        if (!id)
+        {
+            OnLookupResponse(lookup, slot, provider, HttpResponse{}, *page);
+            return;
+        }
+
+        bool lost = false;
+        {
+            std::lock_guard<std::mutex> lock(lookup->mutex);
+            lookup->requestIds[slot] = id;
+            lost = lookup->settled;
+        }
+        if (lost)
+            http.Cancel(id);
     }
 
-    std::string HttpGetRequest(const std::wstring& host, const std::wstring& path)
+    void OnLookupResponse(const std::shared_ptr<HedgedLookup>& lookup, int slot, size_t provider, const HttpResponse& response, const PageScanner& page)
     {
-        std::string response;
-        HINTERNET session = WinHttpOpen(L"USBDetector", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-        if (!session) return "";
+        bool failed = false;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            failed = RecordResponse(webProviders[provider].host, response, StatsFor(lookup->task.scanId));
+            if (!failed)
+                webProviders[provider].latency.Add(response.elapsedMs);
+        }
+        cv.notify_one();
 
-        HINTERNET connection = WinHttpConnect(session, host.c_str(), INTERNET_DEFAULT_HTTPS_PORT, 0);
-        HINTERNET request = WinHttpOpenRequest(connection, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_SECURE);
+        // The first good answer settles the lookup. A failure only settles it once no other request
+        // is still racing, since that one may yet succeed.
+        uint64_t loser = 0;
+        {
+            std::lock_guard<std::mutex> lock(lookup->mutex);
+            --lookup->outstanding;
+            if (lookup->settled || (failed && lookup->outstanding > 0))
+                return;
+            lookup->settled = true;
+            if (lookup->outstanding > 0)
+                loser = lookup->requestIds[1 - slot];
+        }
+        if (loser)
+            http.Cancel(loser);
 
-        if (WinHttpSendRequest(request, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) && WinHttpReceiveResponse(request, nullptr))
         {
-            DWORD bytesAvailable = 0;
-            while (WinHttpQueryDataAvailable(request, &bytesAvailable) && bytesAvailable > 0)
+            std::lock_guard<std::mutex> lock(queueMutex);
+            scanLatency.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lookup->started).count());
+            StatsFor(lookup->task.scanId).hedgeWins += (slot == 1 && !failed) ? 1 : 0;
+        }
+
+        FinalizeLookup(lookup->task, response, page, failed);
+    }
+
+    void FinalizeLookup(const LookupTask& task, const HttpResponse& response, const PageScanner& page, bool failed)
+    {
+        const std::string& html = response.body;
+        bool missing = response.statusCode == 404 || response.statusCode == 410;
+        bool retrying = false;
+
+        // Only shutdown cancels a lookup outright; that is not the key's fault.
+        if (response.cancelled)
+        {
+            FinishLookup(task);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+
+            // A retry is only worth it if it can still finish inside this scan.
+            if (failed)
             {
-                std::vector<char> buffer(bytesAvailable);
-                DWORD bytesRead = 0;
-                WinHttpReadData(request, buffer.data(), bytesAvailable, &bytesRead);
-                response.append(buffer.data(), bytesRead);
+                auto notBefore = std::chrono::steady_clock::now() + JitteredBackoff(task.attempt, rng);
+                if (!done && notBefore < scanDeadline && retryBudget.TryWithdraw())
+                {
+                    LookupTask retry = task;
+                    ++retry.attempt;
+                    retry.notBefore = notBefore;
+                    delayedLookups.push_back(retry);
+                    ++StatsFor(task.scanId).retries;
+                    retrying = true;
+                }
             }
         }
+        cv.notify_one();
 
-        WinHttpCloseHandle(request);
-        WinHttpCloseHandle(connection);
-        WinHttpCloseHandle(session);
+        if (retrying)
+            return;
 
-        return response;
+        // A failed lookup only records its backoff; the device keeps its SetupDi names.
+        if (failed)
+        {
+            nameCache.StoreFailure(task.packedKey);
+            FinishLookup(task);
+            return;
+        }
+
+        // Not modified: the names we already hold are good for another TTL.
+        if (response.statusCode == 304)
+        {
+            USBDeviceInfo info;
+            if (nameCache.Revalidate(task.packedKey, info.DeviceName, info.VendorName))
+                resolvedNames.Store(task.packedKey, info.DeviceName, info.VendorName);
+            FinishLookup(task);
+            return;
+        }
+
+        USBDeviceInfo info;
+        LookupOutcome outcome = LookupOutcome::NotFound;
+        if (!missing)
+        {
+            info.DeviceName = std::string(page.scanner.Value(html, page.deviceField));
+            info.VendorName = std::string(page.scanner.Value(html, page.vendorField));
+            outcome = (info.DeviceName.empty() && info.VendorName.empty()) ? LookupOutcome::ParseError : LookupOutcome::Found;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            LookupStats& stats = StatsFor(task.scanId);
+            stats.notFound += outcome == LookupOutcome::NotFound ? 1 : 0;
+            stats.parseErrors += outcome == LookupOutcome::ParseError ? 1 : 0;
+        }
+
+        nameCache.Store(task.packedKey, outcome, info.DeviceName, info.VendorName, response.etag, response.lastModified);
+        resolvedNames.Store(task.packedKey, info.DeviceName, info.VendorName);
+
+        FinishLookup(task);
     }
 
-    void WebLookupWorker()
+    struct VendorPage
+    {
+        HtmlFieldScanner scanner;
+        size_t vendorField = scanner.Add("details --type-vendor --auto-link\"><h3 class='details__heading'>", "</h3><table");
+        VendorListingParser listing;
+        bool vendorDone = false;
+
+        bool Feed(std::string_view body)
+        {
+            vendorDone = vendorDone || scanner.Feed(body);
+            return listing.Feed(body) && vendorDone;
+        }
+    };
+
+    // Devices named in the listing are resolved here; the rest go back on the queue as ordinary
+    // per-device lookups.
+    void OnVendorResponse(const std::string& vid, const HttpResponse& response, const VendorPage& page)
+    {
+        std::vector<LookupTask> tasks;
+        bool failed = false;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks = std::move(vendorBatches[vid]);
+            vendorBatches.erase(vid);
+            // Counted against the scan whose task started the batch.
+            failed = RecordResponse(webProviders[0].host, response, StatsFor(tasks.empty() ? scanId : tasks.front().scanId));
+        }
+
+        std::string vendorName = failed ? std::string() : std::string(page.scanner.Value(response.body, page.vendorField));
+        std::vector<LookupTask> unresolved;
+        for (const LookupTask& task : tasks)
+        {
+            std::string deviceName = failed ? std::string() : page.listing.Name(static_cast<uint16_t>(task.packedKey & 0xFFFF));
+            if (deviceName.empty())
+            {
+                unresolved.push_back(task);
+                continue;
+            }
+
+            USBDeviceInfo info;
+            info.DeviceName = deviceName;
+            info.VendorName = vendorName;
+            nameCache.Store(task.packedKey, LookupOutcome::Found, info.DeviceName, info.VendorName);
+            resolvedNames.Store(task.packedKey, info.DeviceName, info.VendorName);
+            FinishLookup(task);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            StatsFor(tasks.empty() ? scanId : tasks.front().scanId).batchResolved += tasks.size() - unresolved.size();
+            for (LookupTask& task : unresolved)
+            {
+                task.noBatch = true;
+                EnqueueLookup(task);
+            }
+        }
+        cv.notify_one();
+    }
+
+    // Caller holds queueMutex. Pulls every queued first-attempt task for the task's vendor into
+    // a batch when there are enough of them to make the listing page worth fetching. The PIDs a
+    // listing looks for are fixed when its request starts, so a task for a vendor whose batch is
+    // already in flight is looked up on its own rather than joining it.
+    bool TryStartVendorBatch(const LookupTask& task)
+    {
+        if (!vendorBatching || task.noBatch || task.attempt != 0 || vendorBatches.count(task.vid))
+            return false;
+
+        auto sameVendor = [&](const LookupTask& other) { return other.vid == task.vid && !other.noBatch && other.attempt == 0; };
+        size_t count = 1 + lookupQueue.CountIf(sameVendor);
+        if (count < vendorBatchThreshold)
+            return false;
+
+        std::vector<LookupTask>& tasks = vendorBatches[task.vid];
+        tasks.push_back(task);
+        lookupQueue.ExtractIf(sameVendor, tasks);
+        return true;
+    }
+
+    // Caller holds queueMutex. When the hosts are throttling, whatever capacity is left should go
+    // to the devices the user most likely cares about, hence the levels.
+    void EnqueueLookup(LookupTask task)
+    {
+        if (task.priority > LookupPriority::Visible && visibleKeys.count(task.key))
+            task.priority = LookupPriority::Visible;
+        lookupQueue.Push(task);
+    }
+
+    TokenBucket& LimiterFor(const std::wstring& host)
+    {
+        return hostLimiters[host];
+    }
+
+    // Hedges only go to a second provider on a different host.
+    bool CanHedge() const
+    {
+        return webProviders.size() > 1 && webProviders[1].host != webProviders[0].host;
+    }
+
+
+    // Moves retries whose backoff has elapsed back onto the queue. Caller holds queueMutex.
+    void PromoteDueRetries()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < delayedLookups.size();)
+        {
+            if (delayedLookups[i].notBefore <= now)
+            {
+                EnqueueLookup(delayedLookups[i]);
+                delayedLookups[i] = delayedLookups.back();
+                delayedLookups.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    // Caller holds queueMutex. Hands back lookups whose primary request has outlived the
+    // provider's p95 and reserves a slot for their hedge. Hedges are paid from the retry budget
+    // and are not sent while the breaker is anything but closed.
+    void CollectDueHedges(std::vector<std::shared_ptr<HedgedLookup>>& due)
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < hedgeTimers.size();)
+        {
+            std::shared_ptr<HedgedLookup> lookup = hedgeTimers[i];
+            if (lookup->hedgeAt > now)
+            {
+                ++i;
+                continue;
+            }
+
+            hedgeTimers[i] = hedgeTimers.back();
+            hedgeTimers.pop_back();
+
+            std::lock_guard<std::mutex> lock(lookup->mutex);
+            if (lookup->settled || lookup->hedged || breaker.state != CircuitBreaker::State::Closed)
+                continue;
+
+            // A hedge is optional; if the host has no token to spare it is simply dropped.
+            TokenBucket& limiter = LimiterFor(webProviders[1].host);
+            if (limiter.NextToken(now) > now || !retryBudget.TryWithdraw())
+                continue;
+            limiter.TryTake(now);
+
+            lookup->hedged = true;
+            ++lookup->outstanding;
+            ++activeLookups;
+            LookupStats& stats = StatsFor(lookup->task.scanId);
+            ++stats.httpRequests;
+            ++stats.hedgesSent;
+            due.push_back(lookup);
+        }
+    }
+
+    // Caller holds queueMutex. True when the next queued task may be sent right now.
+    // The clock is read once: NextToken answers "now" when a token is ready, and comparing that
+    // against a second, later reading would fail.
+    bool CanDispatch()
+    {
+        auto now = std::chrono::steady_clock::now();
+        return !lookupQueue.Empty() && activeLookups < concurrency.Limit() && LimiterFor(webProviders[0].host).NextToken(now) <= now;
+    }
+
+    std::chrono::steady_clock::time_point NextWakeTime()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (const auto& task : delayedLookups)
+            next = std::min(next, task.notBefore);
+        for (const auto& lookup : hedgeTimers)
+            next = std::min(next, lookup->hedgeAt);
+        // Completions wake the dispatcher themselves; only a token shortage needs a timer.
+        if (!lookupQueue.Empty() && activeLookups < concurrency.Limit())
+            next = std::min(next, LimiterFor(webProviders[0].host).NextToken(now));
+        return next;
+    }
+
+    // Single thread that feeds the async HTTP engine. The AIMD controller decides how many lookups
+    // may be outstanding, never more than maxInFlight; hedges fire from the same loop.
+    void LookupDispatcher()
     {
         try {
             while (true)
             {
                 LookupTask task;
+                bool haveTask = false;
+                bool rejected = false;
+                bool startBatch = false;
+                std::vector<uint16_t> batchPids;
+                std::vector<std::shared_ptr<HedgedLookup>> dueHedges;
+                std::shared_ptr<HedgedLookup> lookup;
                 {
                     std::unique_lock<std::mutex> lock(queueMutex);
-                    cv.wait(lock, [&]() { return !lookupQueue.empty() || done; });
-                    if (lookupQueue.empty() && done) break;
-                    task = lookupQueue.front();
-                    lookupQueue.pop();
+                    auto ready = [&]()
+                    {
+                        PromoteDueRetries();
+                        CollectDueHedges(dueHedges);
+                        return done || !dueHedges.empty() || CanDispatch();
+                    };
+                    while (!ready())
+                    {
+                        auto wake = NextWakeTime();
+                        if (wake == std::chrono::steady_clock::time_point::max())
+                            cv.wait(lock);
+                        else
+                            cv.wait_until(lock, wake);
+                    }
+                    if (done) break;
+
+                    if (CanDispatch())
+                    {
+                        task = lookupQueue.Pop();
+                        haveTask = true;
+                        startBatch = TryStartVendorBatch(task);
+                        if (startBatch)
+                        {
+                            for (const LookupTask& member : vendorBatches[task.vid])
+                                batchPids.push_back(static_cast<uint16_t>(member.packedKey & 0xFFFF));
+                        }
+                    }
+
+                    if (haveTask && !breaker.Allow())
+                    {
+                        ++StatsFor(task.scanId).breakerRejections;
+                        rejected = true;
+                    }
+                    else if (haveTask)
+                    {
+                        LimiterFor(webProviders[0].host).TryTake();
+                        ++activeLookups;
+                        LookupStats& stats = StatsFor(task.scanId);
+                        ++stats.httpRequests;
+                        stats.vendorBatches += startBatch ? 1 : 0;
+                        if (task.attempt == 0)
+                            retryBudget.OnRequest();
+
+                        if (!startBatch)
+                        {
+                            lookup = std::make_shared<HedgedLookup>();
+                            lookup->task = task;
+                            lookup->outstanding = 1;
+                            lookup->started = std::chrono::steady_clock::now();
+                            lookup->hedgeAt = lookup->started + std::chrono::microseconds(static_cast<long long>(webProviders[0].HedgeDelayMs() * 1000.0));
+                            if (CanHedge())
+                                hedgeTimers.push_back(lookup);
+                        }
+                    }
                 }
 
-                std::wstring queryPath = L"/view/type/usb/vendor/" + std::wstring(task.vid.begin(), task.vid.end()) + L"/device/" + std::wstring(task.pid.begin(), task.pid.end());
-                std::string html = HttpGetRequest(L"devicehunt.com", queryPath);
+                for (const auto& hedged : dueHedges)
+                    StartLookupRequest(hedged, 1, 1);
 
-                std::string deviceName = ExtractHtmlValue(html, "details__heading'>", "</h3><table");
-                std::string vendorName = ExtractHtmlValue(html, "details --type-vendor --auto-link\"><h3 class='details__heading'>", "</h3><table");
+                if (!haveTask)
+                    continue;
 
-                USBDeviceInfo info;
-                info.DeviceName = deviceName.empty() ? "" : deviceName;
-                info.VendorName = vendorName.empty() ? "" : vendorName;
+                if (rejected)
+                {
+                    std::vector<LookupTask> rejectedTasks{ task };
+                    if (startBatch)
+                    {
+                        std::lock_guard<std::mutex> lock(queueMutex);
+                        rejectedTasks = std::move(vendorBatches[task.vid]);
+                        vendorBatches.erase(task.vid);
+                    }
+                    for (const LookupTask& rejectedTask : rejectedTasks)
+                        FinishLookup(rejectedTask);
+                    continue;
+                }
 
+                if (startBatch)
                 {
-                    std::lock_guard<std::mutex> lock(cacheMutex);
-                    deviceCache[task.key] = info;
+                    // One listing page stands in for every queued device of this vendor.
+                    auto vendorPage = std::make_shared<VendorPage>();
+                    vendorPage->listing.vid = static_cast<uint16_t>(task.packedKey >> 16);
+                    for (uint16_t pid : batchPids)
+                        vendorPage->listing.Want(pid);
+
+                    std::string vid = task.vid;
+                    const WebProvider& source = webProviders[0];
+                    uint64_t started = http.GetAsync(source.host, source.port, source.secure, source.VendorPath(vid),
+                        [this, vid, vendorPage](HttpResponse& response) { OnVendorResponse(vid, response, *vendorPage); },
+                        [vendorPage](std::string_view body) { return vendorPage->Feed(body); });
+                    if (!started)
+                        OnVendorResponse(vid, HttpResponse{}, *vendorPage);
+                    continue;
                 }
+
+                StartLookupRequest(lookup, 0, 0);
             }
         }
         catch (const std::exception& e) {
-            std::cerr << "Exception in WebLookupWorker: " << e.what() << std::endl; // debug
+            std::cerr << "Exception in LookupDispatcher: " << e.what() << std::endl; // debug
         }
         catch (...) {
-            std::cerr << "Unknown exception in WebLookupWorker" << std::endl; // debug
+            std::cerr << "Unknown exception in LookupDispatcher" << std::endl; // debug
         }
     }
 
-    bool GetDeviceInfo(SP_DEVINFO_DATA& dev, HDEVINFO& hDevInfo, USBDeviceInfo& deviceInfo, bool isConnected)
+    std::chrono::hours phantomAge{ 24 * 30 };
+
+    static std::chrono::hours FileTimeAge(uint64_t ticks)
+    {
+        FILETIME now{};
+        GetSystemTimeAsFileTime(&now);
+        uint64_t current = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+        return std::chrono::hours(current > ticks ? (current - ticks) / 36000000000ULL : 0);
+    }
+
+    static LookupPriority ClassifyLookup(const std::string& service, const std::string& name, bool isConnected, bool removedRecently)
+    {
+        if (!isConnected)
+            return removedRecently ? LookupPriority::Removed : LookupPriority::Phantom;
+
+        bool suspicious = service == "USBSTOR" || service == "UASPStor" || service == "HidUsb" || name.find("Mass Storage") != std::string::npos;
+        return suspicious ? LookupPriority::ConnectedStorage : LookupPriority::Connected;
+    }
+
+    // Called from the UI with the instance ids of the rows on screen; their lookups jump ahead of
+    // everything but connected storage.
+    void SetVisibleDevices(const std::vector<std::string>& instanceIds)
     {
-        wchar_t buf[512]{};
-        std::wstring wInst(MAX_DEVICE_ID_LEN, L'\0');
+        std::set<std::string> keys;
+        for (const std::string& instanceId : instanceIds)
+        {
+            size_t v = instanceId.find("VID_");
+            size_t p = instanceId.find("PID_");
+            if (v != std::string::npos && p != std::string::npos)
+                keys.insert(instanceId.substr(v + 4, 4) + ":" + instanceId.substr(p + 4, 4));
+        }
 
-        if (!SetupDiGetDeviceRegistryPropertyW(hDevInfo, &dev, SPDRP_FRIENDLYNAME, nullptr, (PBYTE)buf, sizeof(buf), nullptr))
-            SetupDiGetDeviceRegistryPropertyW(hDevInfo, &dev, SPDRP_DEVICEDESC, nullptr, (PBYTE)buf, sizeof(buf), nullptr);
-        deviceInfo.name = WideToUtf8(buf);
+        std::lock_guard<std::mutex> lock(queueMutex);
+        visibleKeys = std::move(keys);
+        for (const std::string& key : visibleKeys)
+            lookupQueue.Raise(key, LookupPriority::Visible);
+    }
+
+    bool FindLocalNames(uint32_t packedKey, std::string_view& deviceName, std::string_view& vendorName) const
+    {
+        for (const NameProvider* provider : localProviders)
+        {
+            if (provider->Lookup(packedKey, deviceName, vendorName))
+                return true;
+        }
+        return false;
+    }
+
+    bool GetDeviceInfo(const DevnodeRecord& record, USBDeviceInfo& deviceInfo)
+    {
+        deviceInfo.name = record.name;
 
         if (deviceInfo.name.find("USB Root Hub") != std::string::npos || deviceInfo.name.find("USB Hub") != std::string::npos)
             return false;
 
-        SetupDiGetDeviceRegistryPropertyW(hDevInfo, &dev, SPDRP_MFG, nullptr, (PBYTE)buf, sizeof(buf), nullptr);
-        deviceInfo.vendor = WideToUtf8(buf);
+        deviceInfo.vendor = record.vendor;
+        deviceInfo.instanceId = record.instanceId;
 
-        CM_Get_Device_IDW(dev.DevInst, &wInst[0], MAX_DEVICE_ID_LEN, 0);
-        deviceInfo.instanceId = WideToUtf8(wInst);
+        deviceInfo.connectTime = FileTimeToString(record.arrivalTime);
+        deviceInfo.lastRemovalTime = FileTimeToString(record.removalTime);
+        deviceInfo.status = (record.status & DN_HAS_PROBLEM) ? "No" : "Yes";
+        deviceInfo.capabilities = CapabilitiesToString(record.capabilities);
+        deviceInfo.isConnected = record.present;
 
-        size_t v = wInst.find(L"VID_");
-        size_t p = wInst.find(L"PID_");
-        if (v != std::wstring::npos && p != std::wstring::npos)
-            deviceInfo.vidpid = WideToUtf8(wInst.substr(v + 4, 4)) + " / " + WideToUtf8(wInst.substr(p + 4, 4));
+        // Without a full VID_xxxx and PID_xxxx (an id that could not be read, a root hub) there is
+        // nothing to look up, so the devnode's own names stand.
+        const std::string& instanceId = record.instanceId;
+        size_t v = instanceId.find("VID_");
+        size_t p = instanceId.find("PID_");
+        if (v == std::string::npos || p == std::string::npos || instanceId.size() < v + 8 || instanceId.size() < p + 8)
+        {
+            deviceInfo.DeviceName = deviceInfo.name;
+            deviceInfo.VendorName = deviceInfo.vendor;
+            return true;
+        }
 
-        std::string vid = WideToUtf8(wInst.substr(v + 4, 4));
-        std::string pid = WideToUtf8(wInst.substr(p + 4, 4));
+        std::string vid = instanceId.substr(v + 4, 4);
+        std::string pid = instanceId.substr(p + 4, 4);
+        deviceInfo.vidpid = vid + " / " + pid;
         std::string key = vid + ":" + pid;
+        uint32_t packedKey = PackVidPid(vid, pid);
+        bool backingOff = false;
+        std::string staleDevice, staleVendor;
+
+        bool removedRecently = record.removalTime && FileTimeAge(record.removalTime) < phantomAge;
+        LookupPriority priority = ClassifyLookup(record.service, deviceInfo.name, record.present, removedRecently);
 
+        // Names already resolved are read without a lock; only a miss goes on to the offline
+        // sources, the disk cache and finally the lookup queue.
+        const NameEntry* resolved = resolvedNames.Find(packedKey);
+        if (!resolved)
         {
-            std::lock_guard<std::mutex> lock(cacheMutex);
-            if (deviceCache.find(key) != deviceCache.end())
+            std::string_view tableDevice, tableVendor;
+            std::string diskDevice, diskVendor;
+            LookupOutcome outcome = LookupOutcome::Found;
+            if (FindLocalNames(packedKey, tableDevice, tableVendor))
             {
-                deviceInfo.DeviceName = deviceCache[key].DeviceName;
-                deviceInfo.VendorName = deviceCache[key].VendorName;
+                resolvedNames.Store(packedKey, std::string(tableDevice), std::string(tableVendor));
+                resolved = resolvedNames.Find(packedKey);
+                std::lock_guard<std::mutex> lock(queueMutex);
+                ++scanStats.tableHits;
             }
-            else
+            else if (nameCache.Find(packedKey, diskDevice, diskVendor, outcome))
             {
-                LookupTask task{ vid, pid, key };
+                std::lock_guard<std::mutex> lock(queueMutex);
+                if (outcome == LookupOutcome::TransientError)
                 {
-                    std::lock_guard<std::mutex> qLock(queueMutex);
-                    lookupQueue.push(task);
+                    ++scanStats.backoffSkips;
+                    backingOff = true;
+                    staleDevice = diskDevice;
+                    staleVendor = diskVendor;
+                }
+                else
+                {
+                    resolvedNames.Store(packedKey, diskDevice, diskVendor);
+                    resolved = resolvedNames.Find(packedKey);
+                    ++scanStats.diskHits;
                 }
-                deviceInfo.DeviceName = deviceInfo.name;  // Fallback
-                deviceInfo.VendorName = deviceInfo.vendor;  // Fallback
             }
         }
 
-        FILETIME ft{};
-        if (GetDevNodeTime(dev.DevInst, DEVPKEY_Device_LastArrivalDate, ft))
-            deviceInfo.connectTime = FileTimeToString(ft);
-
-        if (GetDevNodeTime(dev.DevInst, DEVPKEY_Device_LastRemovalDate, ft))
-            deviceInfo.lastRemovalTime = FileTimeToString(ft);
-
-        ULONG status = 0, problem = 0;
-        CM_Get_DevNode_Status(&status, &problem, dev.DevInst, 0);
-        deviceInfo.status = (status & DN_HAS_PROBLEM) ? "No" : "Yes";
-
-        DWORD caps = 0;
-        ULONG size = sizeof(DWORD);
-        CM_Get_DevNode_Registry_PropertyW(dev.DevInst, CM_DRP_CAPABILITIES, nullptr, &caps, &size, 0);
-        deviceInfo.capabilities = CapabilitiesToString(caps);
-
-        deviceInfo.isConnected = isConnected;
+        if (backingOff)
+        {
+            // Names from before the failures, if any, beat the SetupDi ones.
+            deviceInfo.DeviceName = staleDevice.empty() ? deviceInfo.name : staleDevice;
+            deviceInfo.VendorName = staleVendor.empty() ? deviceInfo.vendor : staleVendor;
+        }
+        else if (resolved)
+        {
+            deviceInfo.DeviceName = resolved->DeviceName.empty() ? deviceInfo.name : resolved->DeviceName;
+            deviceInfo.VendorName = resolved->VendorName.empty() ? deviceInfo.vendor : resolved->VendorName;
+        }
+        else
+        {
+            bool queued = false;
+            {
+                // Devnodes sharing a VID:PID ride on the lookup already in flight for that key. A
+                // lookup that finished since the miss above has left its names behind; no need to ask again.
+                std::lock_guard<std::mutex> lock(queueMutex);
+                if (resolvedNames.Find(packedKey))
+                {
+                    ++scanStats.deduplicated;
+                }
+                else if (inFlightKeys.insert(key).second)
+                {
+                    LookupTask task{ vid, pid, key, packedKey };
+                    task.priority = priority;
+                    task.scanId = scanId;
+                    // A revalidation is a cheap conditional GET of its own page, so it stays out of vendor batches.
+                    if (nameCache.FindStale(packedKey, task.etag, task.lastModified))
+                    {
+                        task.noBatch = true;
+                        ++scanStats.revalidations;
+                    }
+                    EnqueueLookup(task);
+                    ++pendingLookups;
+                    ++scanStats.queued;
+                    scanStats.priorityQueued += priority == LookupPriority::ConnectedStorage ? 1 : 0;
+                    queued = true;
+                }
+                else
+                {
+                    ++scanStats.deduplicated;
+                    // A later devnode can lift a key already queued (the storage interface
+                    // of a composite device, say).
+                    lookupQueue.Raise(key, priority);
+                }
+            }
+            if (queued)
+                cv.notify_one();
+            deviceInfo.DeviceName = deviceInfo.name;  // Fallback
+            deviceInfo.VendorName = deviceInfo.vendor;  // Fallback
+        }
 
         return true;
     }
 
+    // Full scan: every property of every devnode is read again.
     std::vector<USBDeviceInfo> GetDevices()
     {
-        workers.clear();
-        done = false;
-
-        HDEVINFO hDevInfoPresent = SetupDiGetClassDevsW(nullptr, L"USB", nullptr, DIGCF_PRESENT | DIGCF_ALLCLASSES);
-        HDEVINFO hDevInfoAll = SetupDiGetClassDevsW(nullptr, L"USB", nullptr, DIGCF_ALLCLASSES);
+        return Scan(false);
+    }
 
-        SP_DEVINFO_DATA dev{};
-        dev.cbSize = sizeof(dev);
+    // Incremental scan against the previous snapshot: only devnodes whose signature changed are
+    // re-read, and lastDelta says which ones were added, changed or removed.
+    std::vector<USBDeviceInfo> Rescan()
+    {
+        return Scan(true);
+    }
 
-        std::set<std::string> presentInstanceIds;
+    // Hotplug update: only the devnodes named in the batch are re-read. A batch that lost events
+    // falls back to a rescan. Rows come back with whatever names are known now; lookups for new
+    // devices keep running and the caller picks them up through namesVersion.
+    std::vector<USBDeviceInfo> Update(const HotplugBatch& batch)
+    {
+        std::vector<USBDeviceInfo> devices = Scan(true, batch.overflow ? nullptr : &batch.instanceIds, false);
+        std::lock_guard<std::mutex> lock(queueMutex);
+        scanStats.hotplugEvents = batch.events;
+        scanStats.hotplugMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch.firstEvent).count();
+        return devices;
+    }
 
-        const int numThreads = 4;
-        for (int i = 0; i < numThreads; ++i)
+    // Overwrites the SetupDi names with any resolved ones. Safe to call from the UI thread while
+    // lookups are running; resolvedNames is read lock-free.
+    void ApplyResolvedNames(std::vector<USBDeviceInfo>& devices)
+    {
+        for (auto& deviceInfo : devices)
         {
-            workers.emplace_back(&USBDetector::WebLookupWorker, this);
+            size_t v = deviceInfo.instanceId.find("VID_");
+            size_t p = deviceInfo.instanceId.find("PID_");
+            if (v != std::string::npos && p != std::string::npos)
+            {
+                const NameEntry* resolved = resolvedNames.Find(PackVidPid(deviceInfo.instanceId.substr(v + 4, 4), deviceInfo.instanceId.substr(p + 4, 4)));
+                if (resolved)
+                {
+                    if (!resolved->DeviceName.empty())
+                        deviceInfo.DeviceName = resolved->DeviceName;
+                    if (!resolved->VendorName.empty())
+                        deviceInfo.VendorName = resolved->VendorName;
+                }
+            }
         }
+    }
 
-        int index = 0;
-        while (SetupDiEnumDeviceInfo(hDevInfoPresent, index++, &dev))
+    std::vector<USBDeviceInfo> Scan(bool incremental, const std::vector<std::string>* instanceIds = nullptr, bool waitForNames = true)
+    {
+        nameCache.Open();
+        std::call_once(offlineSourcesOnce, [&]()
         {
-            std::wstring wInst(MAX_DEVICE_ID_LEN, L'\0');
-            CM_Get_Device_IDW(dev.DevInst, &wInst[0], MAX_DEVICE_ID_LEN, 0);
-            presentInstanceIds.insert(WideToUtf8(wInst));
-        }
+            usbIdsFile.OpenDefault();
+            hwdb.OpenDefault();
+            // A user-supplied usb.ids is assumed newer than the other two.
+            localProviders = { &usbIdsFile, &hwdb, &embeddedIds };
+        });
+        StartDispatcher();
 
-        std::vector<USBDeviceInfo> devices;
-        index = 0;
-        while (SetupDiEnumDeviceInfo(hDevInfoAll, index++, &dev))
         {
-            std::wstring wInst(MAX_DEVICE_ID_LEN, L'\0');
-            CM_Get_Device_IDW(dev.DevInst, &wInst[0], MAX_DEVICE_ID_LEN, 0);
-            std::string instanceId = WideToUtf8(wInst);
-            bool isConnected = presentInstanceIds.count(instanceId) > 0;
-
-            USBDeviceInfo deviceInfo;
-            if (GetDeviceInfo(dev, hDevInfoAll, deviceInfo, isConnected))
-            {
-                devices.push_back(deviceInfo);
-            }
+            std::lock_guard<std::mutex> lock(queueMutex);
+            // The finished scan keeps collecting whatever of its lookups is still out.
+            if (scanId)
+                pastScans[scanId] = scanStats;
+            while (pastScans.size() > maxPastScans)
+                pastScans.erase(pastScans.begin());
+            ++scanId;
+            scanStats = LookupStats{};
+            scanStarted = std::chrono::steady_clock::now();
+            scanDeadline = scanStarted + scanBudget;
+            retryBudget.Reset();
+            scanLatency = LatencyTracker{};
+            scanLatency.capacity = 4096;
         }
+        size_t handshakesBefore = http.handshakes;
+        size_t drainedBefore = http.drainedStops;
+        size_t growthsBefore = http.bufferGrowths;
+        size_t copiedBefore = http.bytesCopied;
 
+        auto enumerateStart = std::chrono::steady_clock::now();
+        if (!incremental)
+            snapshot.valid = false;
+        if (instanceIds)
+            snapshot.Update(*devnodes, *instanceIds, lastDelta);
+        else
+            snapshot.Rescan(*devnodes, lastDelta);
         {
             std::lock_guard<std::mutex> lock(queueMutex);
-            done = true;
+            scanStats.enumerateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - enumerateStart).count();
+            scanStats.devnodes = snapshot.records.size();
+            scanStats.devnodesFilled = lastDelta.added.size() + lastDelta.changed.size();
+            scanStats.devnodesAdded = incremental ? lastDelta.added.size() : 0;
+            scanStats.devnodesChanged = lastDelta.changed.size();
+            scanStats.devnodesRemoved = lastDelta.removed.size();
         }
-        cv.notify_all();
 
-        for (auto& worker : workers)
+        std::vector<USBDeviceInfo> devices;
+        for (const DevnodeRecord& record : snapshot.records)
         {
-            worker.join();
+            USBDeviceInfo deviceInfo;
+            if (GetDeviceInfo(record, deviceInfo))
+            {
+                devices.push_back(deviceInfo);
+            }
         }
 
-        workers.clear();
+        if (waitForNames)
+            WaitForLookups();
 
-        for (auto& deviceInfo : devices)
         {
-            size_t v = deviceInfo.instanceId.find("VID_");
-            size_t p = deviceInfo.instanceId.find("PID_");
-            if (v != std::string::npos && p != std::string::npos)
-            {
-                std::string vid = deviceInfo.instanceId.substr(v + 4, 4);
-                std::string pid = deviceInfo.instanceId.substr(p + 4, 4);
-                std::string key = vid + ":" + pid;
-
-                std::lock_guard<std::mutex> lock(cacheMutex);
-                if (deviceCache.find(key) != deviceCache.end())
-                {
-                    if (!deviceCache[key].DeviceName.empty())
-                        deviceInfo.DeviceName = deviceCache[key].DeviceName;
-                    if (!deviceCache[key].VendorName.empty())
-                        deviceInfo.VendorName = deviceCache[key].VendorName;
-                }
-            }
+            std::lock_guard<std::mutex> lock(queueMutex);
+            scanStats.handshakes = http.handshakes - handshakesBefore;
+            scanStats.drainedStops = http.drainedStops - drainedBefore;
+            scanStats.bufferGrowths = http.bufferGrowths - growthsBefore;
+            scanStats.bytesCopied = http.bytesCopied - copiedBefore;
+            scanStats.p50Ms = scanLatency.Percentile(0.50);
+            scanStats.p99Ms = scanLatency.Percentile(0.99);
         }
 
-        SetupDiDestroyDeviceInfoList(hDevInfoPresent);
-        SetupDiDestroyDeviceInfoList(hDevInfoAll);
+        ApplyResolvedNames(devices);
 
         return devices;
     }
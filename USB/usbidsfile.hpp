@@ -0,0 +1,175 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mappedfile.hpp"
+#include "providers.hpp"
+
+// A usb.ids file supplied at runtime. The file is mapped, indexed in one pass over its lines,
+// and names are only cut out of the mapping when a lookup asks for them.
+struct UsbIdsFile : NameProvider
+{
+    struct VendorEntry
+    {
+        uint16_t vid;
+        uint32_t lineOffset;
+        uint32_t firstDevice;
+        uint32_t deviceCount;
+    };
+
+    struct DeviceEntry
+    {
+        uint16_t pid;
+        uint32_t lineOffset;
+    };
+
+    MappedFile file;
+    std::vector<VendorEntry> vendors;
+    std::vector<DeviceEntry> devices;
+
+    static int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool ParseId(const char* p, const char* end, uint16_t& id)
+    {
+        if (end - p < 5)
+            return false;
+
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            int d = HexDigit(p[i]);
+            if (d < 0) return false;
+            value = (value << 4) | static_cast<uint32_t>(d);
+        }
+
+        if (p[4] != ' ' && p[4] != '\t')
+            return false;
+
+        id = static_cast<uint16_t>(value);
+        return true;
+    }
+
+#ifdef _WIN32
+    // Tries the copy next to the executable, then %LOCALAPPDATA%\USBDetector\usb.ids.
+    bool OpenDefault()
+    {
+        wchar_t buf[MAX_PATH]{};
+        DWORD len = GetModuleFileNameW(nullptr, buf, MAX_PATH);
+        if (len > 0 && len < MAX_PATH)
+        {
+            std::wstring exePath(buf, len);
+            size_t slash = exePath.find_last_of(L"\\/");
+            if (slash != std::wstring::npos && Open(exePath.substr(0, slash + 1) + L"usb.ids"))
+                return true;
+        }
+
+        std::wstring dir = GetAppDataDirectory();
+        return !dir.empty() && Open(dir + L"\\usb.ids");
+    }
+
+    bool Open(const std::wstring& path)
+#else
+    // Where distributions install it: hwdata, then the older usbutils locations.
+    bool OpenDefault()
+    {
+        return Open("/usr/share/hwdata/usb.ids") || Open("/usr/share/misc/usb.ids") || Open("/var/lib/usbutils/usb.ids");
+    }
+
+    bool Open(const std::string& path)
+#endif
+    {
+        vendors.clear();
+        devices.clear();
+        if (!file.Open(path))
+            return false;
+
+        vendors.reserve(4096);
+        devices.reserve(32768);
+
+        const char* base = file.data;
+        const char* end = base + file.size;
+        const char* line = base;
+
+        while (line < end)
+        {
+            const char* nl = static_cast<const char*>(memchr(line, '\n', static_cast<size_t>(end - line)));
+            const char* lineEnd = nl ? nl : end;
+            uint16_t id = 0;
+
+            if (line[0] == '\t')
+            {
+                // Single tab is a device; a second tab marks an interface line, which we don't need.
+                if (!vendors.empty() && line + 1 < lineEnd && line[1] != '\t' && ParseId(line + 1, lineEnd, id))
+                {
+                    devices.push_back(DeviceEntry{ id, static_cast<uint32_t>(line + 1 - base) });
+                    ++vendors.back().deviceCount;
+                }
+            }
+            else if (ParseId(line, lineEnd, id))
+            {
+                vendors.push_back(VendorEntry{ id, static_cast<uint32_t>(line - base), static_cast<uint32_t>(devices.size()), 0 });
+            }
+            else if (lineEnd - line >= 2 && line[0] == 'C' && line[1] == ' ')
+            {
+                // Device classes and the other tables follow the vendor list.
+                break;
+            }
+
+            line = lineEnd + 1;
+        }
+
+        // usb.ids is kept sorted upstream, but a hand-edited copy might not be.
+        for (const auto& vendor : vendors)
+        {
+            auto first = devices.begin() + vendor.firstDevice;
+            std::stable_sort(first, first + vendor.deviceCount, [](const DeviceEntry& a, const DeviceEntry& b) { return a.pid < b.pid; });
+        }
+        std::stable_sort(vendors.begin(), vendors.end(), [](const VendorEntry& a, const VendorEntry& b) { return a.vid < b.vid; });
+
+        return !vendors.empty();
+    }
+
+    std::string_view NameAt(uint32_t lineOffset) const
+    {
+        const char* p = file.data + lineOffset + 4;
+        const char* end = file.data + file.size;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            ++p;
+
+        const char* lineEnd = p;
+        while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+            ++lineEnd;
+
+        return std::string_view(p, static_cast<size_t>(lineEnd - p));
+    }
+
+    bool Lookup(uint32_t key, std::string_view& deviceName, std::string_view& vendorName) const override
+    {
+        uint16_t vid = static_cast<uint16_t>(key >> 16);
+        uint16_t pid = static_cast<uint16_t>(key & 0xFFFF);
+
+        auto v = std::lower_bound(vendors.begin(), vendors.end(), vid, [](const VendorEntry& e, uint16_t id) { return e.vid < id; });
+        if (v == vendors.end() || v->vid != vid)
+            return false;
+        vendorName = NameAt(v->lineOffset);
+
+        auto first = devices.begin() + v->firstDevice;
+        auto last = first + v->deviceCount;
+        auto d = std::lower_bound(first, last, pid, [](const DeviceEntry& e, uint16_t id) { return e.pid < id; });
+        if (d == last || d->pid != pid)
+            return false;
+        deviceName = NameAt(d->lineOffset);
+
+        return true;
+    }
+};
@@ -0,0 +1,153 @@
+﻿// Startup benchmark for UsbIdsFile on a synthetic usb.ids the size of the real one (~700 KB,
+// 3,000 vendors, 21,000 devices, interface lines and a class table after the vendor list).
+// Times opening the file, which maps and indexes it, against parsing every name into a map,
+// then checks a sample of lookups. From the repo root:
+//   g++ -std=c++17 -O2 -Wall -Wextra -I. USB/usbidsfile_bench.cpp -o usbidsfile_bench && ./usbidsfile_bench
+#include "usbidsfile.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+using Clock = std::chrono::steady_clock;
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static double MsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+template <typename Body>
+static double BestOf(int runs, Body body)
+{
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = Clock::now();
+        body();
+        best = std::min(best, MsSince(start));
+    }
+    return best;
+}
+
+static const size_t kVendors = 3000;
+static const size_t kDevicesPerVendor = 7;
+
+static uint16_t VendorId(size_t v)
+{
+    return static_cast<uint16_t>(0x0400 + v * 13);
+}
+
+static uint16_t DeviceId(size_t v, size_t d)
+{
+    return static_cast<uint16_t>((v * 31 + d * 0x1111) & 0xFFFF);
+}
+
+static void WriteUsbIds(const char* path)
+{
+    std::ofstream out(path, std::ios::binary);
+    char line[128];
+    out << "#\n#\tList of USB ID's\n#\n# Version: synthetic\n#\n\n";
+    for (size_t v = 0; v < kVendors; ++v)
+    {
+        snprintf(line, sizeof(line), "%04x  Vendor %zu Electronics Co., Ltd.\n", VendorId(v), v);
+        out << line;
+        for (size_t d = 0; d < kDevicesPerVendor; ++d)
+        {
+            snprintf(line, sizeof(line), "\t%04x  Device %zu model %zu\n", DeviceId(v, d), d, v);
+            out << line;
+            if (d == 0)
+                out << "\t\t00  Interface 0\n";
+        }
+    }
+    out << "\n# List of known device classes, subclasses and protocols\n";
+    for (int c = 0; c < 256; ++c)
+    {
+        snprintf(line, sizeof(line), "C %02x  Class %d\n\t00  Subclass\n", c, c);
+        out << line;
+    }
+}
+
+// What a reader without the index would do: cut every name out of the file up front.
+static size_t ParseAll(const char* path, std::map<uint32_t, std::pair<std::string, std::string>>& names)
+{
+    names.clear();
+    std::ifstream in(path, std::ios::binary);
+    std::string line, vendor;
+    uint32_t vid = 0;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (line.compare(0, 2, "C ") == 0)
+            break;
+        if (line[0] != '\t')
+        {
+            vid = static_cast<uint32_t>(strtoul(line.substr(0, 4).c_str(), nullptr, 16));
+            vendor = line.substr(6);
+        }
+        else if (line.size() > 7 && line[1] != '\t')
+        {
+            uint32_t pid = static_cast<uint32_t>(strtoul(line.substr(1, 4).c_str(), nullptr, 16));
+            names[vid << 16 | pid] = { line.substr(7), vendor };
+        }
+    }
+    return names.size();
+}
+
+int main()
+{
+    const char* path = "usbidsfile_bench.ids";
+    WriteUsbIds(path);
+
+    UsbIdsFile ids;
+    double openMs = BestOf(10, [&]() { ids.Open(std::string(path)); });
+    Check(ids.vendors.size() == kVendors, "every vendor indexed");
+    Check(ids.devices.size() == kVendors * kDevicesPerVendor, "every device indexed, no interfaces");
+
+    std::map<uint32_t, std::pair<std::string, std::string>> parsed;
+    double parseMs = BestOf(10, [&]() { ParseAll(path, parsed); });
+
+    size_t found = 0;
+    auto start = Clock::now();
+    for (const auto& entry : parsed)
+    {
+        std::string_view device, vendor;
+        found += ids.Lookup(entry.first, device, vendor) ? 1 : 0;
+    }
+    double lookupMs = MsSince(start);
+
+    size_t matches = 0;
+    for (const auto& entry : parsed)
+    {
+        std::string_view device, vendor;
+        if (ids.Lookup(entry.first, device, vendor) && entry.second.first == device && entry.second.second == vendor)
+            ++matches;
+    }
+    Check(found == kVendors * kDevicesPerVendor && matches == found, "lookups agree with a full parse");
+
+    std::string_view device, vendor;
+    Check(!ids.Lookup(0x00010001, device, vendor), "unknown vendor");
+
+    printf("usb.ids       %zu bytes\n", ids.file.size);
+    printf("open + index  %6.2f ms\n", openMs);
+    printf("full parse    %6.2f ms\n", parseMs);
+    printf("%zu lookups   %6.2f ms\n", found, lookupMs);
+
+    ids.file.Close();
+    remove(path);
+    if (failures == 0)
+        printf("usbidsfile_bench: all passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -25,7 +25,16 @@ HWND g_hWnd                                    = nullptr;
 USBDetector detector;
 std::vector<USBDeviceInfo> currentDevices;
 std::atomic<bool> isDetecting(false);
+std::atomic<bool> isRescanning(false);
+std::atomic<bool> rescanReady(false);
+std::mutex rescanMutex;
+std::vector<USBDeviceInfo> rescannedDevices;
+std::chrono::steady_clock::time_point rescannedFirstEvent{};
 std::thread usbDetectionThread;
+DeviceMonitor deviceMonitor;
+std::atomic<bool> hotplugReady(false);
+std::mutex hotplugMutex;
+HotplugBatch hotplugPending;
 
 void CreateRenderTarget()
 {
@@ -91,6 +100,123 @@ void UpdateUSBDevices()
     isDetecting = false;
 }
 
+// The table stays up during a rescan, so the result is handed over and swapped in by the UI thread.
+void RescanUSBDevices()
+{
+    std::vector<USBDeviceInfo> devices = detector.Rescan();
+    {
+        std::lock_guard<std::mutex> lock(rescanMutex);
+        rescannedDevices = std::move(devices);
+        rescannedFirstEvent = {};
+    }
+    rescanReady = true;
+    isRescanning = false;
+}
+
+void UpdateHotplugDevices(HotplugBatch batch)
+{
+    std::vector<USBDeviceInfo> devices = detector.Update(batch);
+    {
+        std::lock_guard<std::mutex> lock(rescanMutex);
+        rescannedDevices = std::move(devices);
+        rescannedFirstEvent = batch.firstEvent;
+    }
+    rescanReady = true;
+    isRescanning = false;
+}
+
+void StartRescan()
+{
+    if (isDetecting || isRescanning)
+        return;
+
+    if (usbDetectionThread.joinable()) usbDetectionThread.join();
+    isRescanning = true;
+    usbDetectionThread = std::thread(RescanUSBDevices);
+}
+
+// Runs on the monitor thread. Batches that arrive while a scan is busy are merged here and
+// picked up by the UI thread once it is free.
+void OnHotplugBatch(HotplugBatch& batch)
+{
+    std::lock_guard<std::mutex> lock(hotplugMutex);
+    if (hotplugPending.events == 0 && !hotplugPending.overflow)
+        hotplugPending.firstEvent = batch.firstEvent;
+    for (std::string& id : batch.instanceIds)
+    {
+        if (std::find(hotplugPending.instanceIds.begin(), hotplugPending.instanceIds.end(), id) == hotplugPending.instanceIds.end())
+            hotplugPending.instanceIds.push_back(std::move(id));
+    }
+    hotplugPending.events += batch.events;
+    hotplugPending.overflow = hotplugPending.overflow || batch.overflow;
+    hotplugReady = true;
+}
+
+void StartHotplugUpdate()
+{
+    if (isDetecting || isRescanning)
+        return;
+
+    HotplugBatch batch;
+    {
+        std::lock_guard<std::mutex> lock(hotplugMutex);
+        batch = std::move(hotplugPending);
+        hotplugPending = HotplugBatch{};
+        hotplugReady = false;
+    }
+
+    if (usbDetectionThread.joinable()) usbDetectionThread.join();
+    isRescanning = true;
+    usbDetectionThread = std::thread(UpdateHotplugDevices, std::move(batch));
+}
+
+// Debug overlay, toggled with F3. Lookups that outlive their scan keep counting against it, so
+// the earlier scans are listed too.
+void DrawLookupStats()
+{
+    std::map<uint64_t, LookupStats> scans = detector.StatsSnapshot();
+    uint64_t scanId = scans.rbegin()->first;
+    LookupStats stats = scans.rbegin()->second;
+    scans.erase(scanId);
+
+    ImGui::SetNextWindowBgAlpha(0.85f);
+    ImGui::SetNextWindowSize(ImVec2(360, 0), ImGuiCond_Appearing);
+    if (!ImGui::Begin("Lookup stats", nullptr, ImGuiWindowFlags_NoCollapse))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("Scan #%llu", static_cast<unsigned long long>(scanId));
+    ImGui::Separator();
+    ImGui::Text("Enumerate: %.1f ms, %zu devnodes (%zu filled)", stats.enumerateMs, stats.devnodes, stats.devnodesFilled);
+    ImGui::Text("Devnodes: +%zu ~%zu -%zu", stats.devnodesAdded, stats.devnodesChanged, stats.devnodesRemoved);
+    ImGui::Text("Hotplug: %zu events, %.1f ms", stats.hotplugEvents, stats.hotplugMs);
+    ImGui::Separator();
+    ImGui::Text("Names: %zu table, %zu disk, %zu deduplicated", stats.tableHits, stats.diskHits, stats.deduplicated);
+    ImGui::Text("Queued: %zu (%zu priority), %zu revalidations", stats.queued, stats.priorityQueued, stats.revalidations);
+    ImGui::Text("Backoff skips: %zu, unresolved at deadline: %zu", stats.backoffSkips, stats.unresolvedAtDeadline);
+    ImGui::Text("First relevant name: %.1f ms", stats.firstRelevantMs);
+    ImGui::Separator();
+    ImGui::Text("Requests: %zu, handshakes: %zu, drained stops: %zu", stats.httpRequests, stats.handshakes, stats.drainedStops);
+    ImGui::Text("Latency: p50 %.1f ms, p99 %.1f ms, total %.0f ms", stats.p50Ms, stats.p99Ms, stats.lookupMillis);
+    ImGui::Text("Bytes: %zu read, %zu on the wire, %zu stopped early", stats.bytesRead, stats.wireBytes, stats.stoppedEarly);
+    ImGui::Text("Buffers: %zu growths, %zu bytes copied", stats.bufferGrowths, stats.bytesCopied);
+    ImGui::Text("Not modified: %zu, not found: %zu, parse errors: %zu", stats.notModified, stats.notFound, stats.parseErrors);
+    ImGui::Text("Timeouts: %zu, retries: %zu, throttled: %zu", stats.timeouts, stats.retries, stats.throttled);
+    ImGui::Text("Breaker rejections: %zu", stats.breakerRejections);
+    ImGui::Text("Hedges: %zu sent, %zu won", stats.hedgesSent, stats.hedgeWins);
+    ImGui::Text("Vendor batches: %zu, %zu resolved", stats.vendorBatches, stats.batchResolved);
+
+    if (!scans.empty())
+    {
+        ImGui::Separator();
+        for (auto it = scans.rbegin(); it != scans.rend(); ++it)
+            ImGui::Text("Scan #%llu: %zu requests, %zu not found, %zu timeouts", static_cast<unsigned long long>(it->first), it->second.httpRequests, it->second.notFound, it->second.timeouts);
+    }
+    ImGui::End();
+}
+
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     if (ImGui_ImplWin32_WndProcHandler(hWnd, msg, wParam, lParam))
@@ -227,6 +353,7 @@ int WINAPI WinMain
 
     isDetecting = true;
     usbDetectionThread = std::thread(UpdateUSBDevices);
+    bool hotplugActive = deviceMonitor.Start(OnHotplugBatch);
 
     static bool showLoadingAnimation = true;
     bool done = false;
@@ -316,12 +443,52 @@ int WINAPI WinMain
             }
         } else {
             static bool showUSBHelpPopup = false;
+            static bool resortDevices = false;
+            static double lastHotplugMs = 0.0;
+            static uint64_t shownNamesVersion = 0;
+
+            if (hotplugReady)
+                StartHotplugUpdate();
+
+            if (rescanReady)
+            {
+                std::lock_guard<std::mutex> lock(rescanMutex);
+                currentDevices = std::move(rescannedDevices);
+                rescanReady = false;
+                resortDevices = true;
+                // Measured up to the frame that first shows the new rows.
+                if (rescannedFirstEvent != std::chrono::steady_clock::time_point{})
+                    lastHotplugMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rescannedFirstEvent).count();
+            }
+
+            // Hotplug rows are shown before their lookups finish; names fill in as answers land.
+            uint64_t namesVersion = detector.namesVersion;
+            if (namesVersion != shownNamesVersion)
+            {
+                shownNamesVersion = namesVersion;
+                detector.ApplyResolvedNames(currentDevices);
+                resortDevices = true;
+            }
 
             float buttonSize = 32.0f;
+            float refreshWidth = 110.0f;
 
             ImVec2 winPos = ImGui::GetWindowPos();
             ImVec2 winSize = ImGui::GetWindowSize();
 
+            ImGui::SetCursorScreenPos(ImVec2(winPos.x + winSize.x - buttonSize - refreshWidth - 20.0f, winPos.y + 10.0f));
+            if (ImGui::Button(isRescanning ? "Refreshing..." : "Refresh", ImVec2(refreshWidth, buttonSize)))
+                StartRescan();
+            if (ImGui::IsItemHovered())
+            {
+                if (!hotplugActive)
+                    ImGui::SetTooltip("Device notifications are unavailable; refresh to pick up changes.");
+                else if (lastHotplugMs > 0.0)
+                    ImGui::SetTooltip("Updates live. Last device change showed up after %.0f ms.", lastHotplugMs);
+                else
+                    ImGui::SetTooltip("Updates live as devices come and go.");
+            }
+
             ImGui::SetCursorScreenPos(ImVec2(winPos.x + winSize.x - buttonSize - 10.0f, winPos.y + 10.0f));
 
             if (ImGui::Button("?", ImVec2(buttonSize, buttonSize)))
@@ -371,9 +538,10 @@ int WINAPI WinMain
                 ImGui::TableHeadersRow();
 
                 ImGuiTableSortSpecs* specs = ImGui::TableGetSortSpecs();
-                if (specs && specs->SpecsDirty)
+                if (specs && specs->SpecsCount > 0 && (specs->SpecsDirty || resortDevices))
                 {
                     specs->SpecsDirty = false;
+                    resortDevices = false;
                     int column = specs->Specs[0].ColumnUserID;
                     bool ascending = (specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending);
                     std::sort(currentDevices.begin(), currentDevices.end(), [&](const USBDeviceInfo& a, const USBDeviceInfo& b) {
@@ -391,6 +559,7 @@ int WINAPI WinMain
                         });
                 }
 
+                std::vector<std::string> visibleIds;
                 for (size_t i = 0; i < currentDevices.size(); ++i)
                 {
                     const auto& dev = currentDevices[i];
@@ -406,6 +575,8 @@ int WINAPI WinMain
                         ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.0f, 0.0f, 1.0f));
                     }
                     ImGui::Text("%s", dev.DeviceName.c_str());
+                    if (ImGui::IsItemVisible())
+                        visibleIds.push_back(dev.instanceId);
                     if (isMassStorage) {
                         ImGui::PopStyleColor();
                     }
@@ -482,11 +653,26 @@ int WINAPI WinMain
                     }
                     ImGui::PopID();
                 }
+
+                // Rows on screen get their names looked up ahead of the rest during a rescan.
+                static std::vector<std::string> lastVisibleIds;
+                if (visibleIds != lastVisibleIds)
+                {
+                    lastVisibleIds = visibleIds;
+                    detector.SetVisibleDevices(visibleIds);
+                }
                 ImGui::EndTable();
             }
         }
 
         ImGui::End();
+
+        static bool showLookupStats = false;
+        if (ImGui::IsKeyPressed(ImGuiKey_F3, false))
+            showLookupStats = !showLookupStats;
+        if (showLookupStats)
+            DrawLookupStats();
+
         ImGui::Render();
         const float clear_color_with_alpha[4] = { clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w };
         g_pd3dDeviceContext->OMSetRenderTargets(1, &g_mainRenderTargetView, NULL);
@@ -496,6 +682,7 @@ int WINAPI WinMain
         g_pSwapChain->Present(1, 0);
     }
 
+    deviceMonitor.Stop();
     if (usbDetectionThread.joinable()) usbDetectionThread.join();
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
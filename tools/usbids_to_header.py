@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Turns a usb.ids snapshot into USB/_usbids.hh, the embedded offline name table.
+
+    python tools/usbids_to_header.py usb.ids USB/_usbids.hh
+
+Run it as a pre-build step (or by hand after pulling a newer usb.ids from
+http://www.linux-usb.org/usb.ids). The output holds sorted uint16 vendor and
+uint32 VID:PID key arrays plus offsets into one interned string pool, which
+USB/embeddedids.hpp binary-searches at runtime. The pool is a byte array, the
+way UI/_font.hh embeds the font: MSVC refuses string literals over 64 KB
+(C1091), and the real pool is several hundred KB.
+"""
+
+import hashlib
+import re
+import sys
+
+VENDOR_RE = re.compile(r"^([0-9a-fA-F]{4})\s+(.*)$")
+DEVICE_RE = re.compile(r"^\t([0-9a-fA-F]{4})\s+(.*)$")
+SECTION_RE = re.compile(r"^[A-Z]{1,4} ")
+
+
+def parse(path):
+    vendors = {}
+    devices = {}
+    version = ""
+    vid = None
+    with open(path, "rb") as f:
+        for raw in f:
+            line = raw.decode("utf-8", errors="replace").rstrip("\r\n")
+            if line.startswith("# Version:"):
+                version = line[len("# Version:"):].strip()
+            if not line or line.startswith("#"):
+                continue
+            # Device classes, HID usages and the rest follow the vendor list.
+            if SECTION_RE.match(line):
+                break
+            m = VENDOR_RE.match(line)
+            if m:
+                vid = int(m.group(1), 16)
+                vendors[vid] = m.group(2).strip()
+                continue
+            m = DEVICE_RE.match(line)
+            if m and vid is not None:
+                devices[(vid << 16) | int(m.group(1), 16)] = m.group(2).strip()
+    return vendors, devices, version
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        return 1
+
+    vendors, devices, version = parse(sys.argv[1])
+    with open(sys.argv[1], "rb") as f:
+        digest = hashlib.sha256(f.read()).hexdigest()
+
+    pool = []
+    offsets = {}
+    size = 0
+
+    def intern(name):
+        nonlocal size
+        if name not in offsets:
+            offsets[name] = size
+            pool.append(name.encode("utf-8") + b"\0")
+            size += len(name.encode("utf-8")) + 1
+        return offsets[name]
+
+    vendor_keys = sorted(vendors)
+    device_keys = sorted(devices)
+    vendor_names = [intern(vendors[k]) for k in vendor_keys]
+    device_names = [intern(devices[k]) for k in device_keys]
+
+    def rows(values, fmt, per_line=12):
+        lines = []
+        for i in range(0, len(values), per_line):
+            lines.append(", ".join(fmt % v for v in values[i:i + per_line]) + ", ")
+        return "\n".join(lines)
+
+    with open(sys.argv[2], "w", newline="\n") as out:
+        out.write("#pragma once\n\n")
+        out.write("//Generated by tools/usbids_to_header.py, do not edit\n")
+        # The snapshot the table was built from, so a regenerated header can be checked against it.
+        out.write("//usb.ids version %s, sha256 %s\n" % (version or "unknown", digest))
+        out.write("#define USBIDS_EMBEDDED 1\n")
+        out.write("#define USBIDS_VERSION \"%s\"\n\n" % (version or "unknown"))
+        out.write("static const uint16_t UsbIdsVendorKeys[] = {\n%s\n};\n\n" % rows(vendor_keys, "0x%04x"))
+        out.write("static const uint32_t UsbIdsVendorNames[] = {\n%s\n};\n\n" % rows(vendor_names, "%d"))
+        out.write("static const uint32_t UsbIdsDeviceKeys[] = {\n%s\n};\n\n" % rows(device_keys, "0x%08x", 8))
+        out.write("static const uint32_t UsbIdsDeviceNames[] = {\n%s\n};\n\n" % rows(device_names, "%d"))
+        out.write("static const unsigned char UsbIdsStrings[] = {\n%s\n};\n" % rows(b"".join(pool), "0x%x", 16))
+
+    print("%d vendors, %d devices, %d bytes of names" % (len(vendor_keys), len(device_keys), size))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())